@@ -4,11 +4,10 @@
 #include <cmath>
 #include <string>
 #include <algorithm>
-#include <io.h>
-#include <fcntl.h>
+#include <exception>
 #include <fstream>  
+#include <future>
 #include "common.h"
-#include <comutil.h>
 
 #ifdef _DEBUG
 #include <cassert>
@@ -17,21 +16,9 @@
 #define VERIFY(condition) condition
 #endif
 
-EXTERN_C IMAGE_DOS_HEADER __ImageBase;
-
-BlackmagicRawResourceFormat s_resourceFormat;
-
-IBlackmagicRawClipAudio* audio = nullptr;
-
-static const int s_maxJobsInFlight = 3;
-static std::atomic<int> s_jobsInFlight = { 0 };
-
-struct UserData
-{
-	unsigned long long frameIndex;
-	bool* job_done = false;
-	uint8_t* avs_framebuffer;
-};
+static const int s_maxReadAhead = 16;
+static const int s_maxStartedJobs = 4;         //read ahead handed to the sdk at once, like the sdk samples keep a few jobs in flight
+static const unsigned s_maxOpenThreads = 8;
 
 static inline std::string getCurrentDateTime(std::string s) {
 	time_t now = time(0);
@@ -61,7 +48,7 @@ public:
 
 	std::atomic<ULONG> m_refCount;
 
-	CameraCodecCallback::CameraCodecCallback() {
+	CameraCodecCallback() {
 		m_refCount = 1;
 	}
 
@@ -69,97 +56,51 @@ public:
 
 	virtual void ReadComplete(IBlackmagicRawJob* readJob, HRESULT result, IBlackmagicRawFrame* frame)
 	{
-		
-		char  buf[80];
-
 		Logger("ReadComplete");
-		UserData* userData = nullptr;
-		VERIFY(readJob->GetUserData((void**)&userData));
-
-		IBlackmagicRawJob* decodeAndProcessJob = nullptr;
-
-		if (result == S_OK)
-			VERIFY(frame->SetResourceFormat(s_resourceFormat));//forces output format and bits, must be set for avisynth operation, we dont support 1:1 formats
-
-		Logger("start CreateJobDecodeAndProcessFrame");
-		if (result == S_OK)
-			result = frame->CreateJobDecodeAndProcessFrame(nullptr, nullptr, &decodeAndProcessJob);
-		Logger("created CreateJobDecodeAndProcessFrame");
-
-
-		if (result == S_OK)
-			VERIFY(decodeAndProcessJob->SetUserData(userData));
+		//the reference given away when the job was submitted, the frame is only lent to us
+		SdkRef<IBlackmagicRawJob> ownedJob(readJob);
+		DecodeJob* job = nullptr;
+		VERIFY(readJob->GetUserData((void**)&job));
+		job->decoder->pinWorkerThread();
 
-		Logger("setuserdata done");
+		job->readMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job->submitted).count();
 
 		if (result == S_OK)
-			result = decodeAndProcessJob->Submit();
-
-		Logger("decodeAndProcessJob->Submit() done");
+			result = job->decoder->decodeFrame(job, frame);
 
 		if (result != S_OK)
 		{
 			Logger("Read Error");
-			if (decodeAndProcessJob)
-				decodeAndProcessJob->Release();
-
-			delete userData;
+			//wake up the waiting GetFrame calls with the error
+			job->decoder->jobDone(job, result, nullptr);
 		}
 		Logger("ReadComplete done");
-		readJob->Release();
 	}
 
-	virtual void ProcessComplete(IBlackmagicRawJob* job, HRESULT result, IBlackmagicRawProcessedImage* img)
+	virtual void ProcessComplete(IBlackmagicRawJob* decodeJob, HRESULT result, IBlackmagicRawProcessedImage* img)
 	{
-
 		Logger("Processcomplete");
-		
-		//get pointer to the pic
-		UserData* userData = nullptr;
-		VERIFY(job->GetUserData((void**)&userData));
-		
-		UINT32 w, h;
-		img->GetWidth(&w);
-		img->GetHeight(&h);
 
-		unsigned int size = 0;
-		void* imageData = nullptr;
-		img->GetResource(&imageData);
-		img->GetResourceSizeBytes(&size);
-		
-		////write debug file
-		//char buffer[254]; // make sure it's big enough
-		//snprintf(buffer, sizeof(buffer), "C:\\temp\\file.raw", userData->frameIndex);
-		//std::ofstream filefile (buffer, std::ios::app | std::ios::binary);
-		//if (filefile.is_open())
-		//{
-		//	filefile.write(reinterpret_cast<char*>(imageData), size);
-		//	filefile.close();
-		//}
-
-		memcpy(userData->avs_framebuffer, imageData, size);
-		
-		//finally we can signal avisynth to go on
-		*userData->job_done = true;
-		
+		//img belongs to the decode job and goes away with it, so it is never released on its own
+		SdkRef<IBlackmagicRawJob> ownedJob(decodeJob);
+		DecodeJob* job = nullptr;
+		VERIFY(decodeJob->GetUserData((void**)&job));
+		job->decoder->pinWorkerThread();
 
-		delete userData;
-		
-		//img->Release(); //crashes if we do this AND relese the job!
-		
-		job->Release();
-		
-		--s_jobsInFlight;
-		return;
-		
+		//copies the picture into the frame slots of all sources that joined and signals the waiting GetFrame calls
+		job->decoder->jobDone(job, result, img);
 	}
 
 	virtual void DecodeComplete(IBlackmagicRawJob*, HRESULT) {}
 	virtual void TrimProgress(IBlackmagicRawJob*, float) {}
 	virtual void TrimComplete(IBlackmagicRawJob*, HRESULT) {}
-	virtual void SidecarMetadataParseWarning(IBlackmagicRawClip*, BSTR, uint32_t, BSTR) {}
-	virtual void SidecarMetadataParseError(IBlackmagicRawClip*, BSTR, uint32_t, BSTR) {}
-	virtual void PreparePipelineComplete(void*, HRESULT) {}
+	virtual void SidecarMetadataParseWarning(IBlackmagicRawClip*, SdkString, uint32_t, SdkString) {}
+	virtual void SidecarMetadataParseError(IBlackmagicRawClip*, SdkString, uint32_t, SdkString) {}
+	virtual void PreparePipelineComplete(void* userData, HRESULT result)
+	{
+		Logger("PreparePipelineComplete");
+		((BRawDecoder*)userData)->pipelinePrepared(result);
+	}
 
 	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*)
 	{
@@ -181,184 +122,1803 @@ public:
 };
 
 BRAWSDKProcessor::~BRAWSDKProcessor() {
+	//jobs in flight must not copy into us anymore, the decoder goes away with its last source
+	if (decoder)
+		decoder->detach(this);
+}
+
+BRawDecoder::~BRawDecoder() {
+
+	//still opening files that nobody asked for yet
+	if (opener.joinable())
+		opener.join();
+
+	//reads bitstream sizes from the clips, must be gone before them
+	fileReadAhead.reset();
+
+	//the pipeline callback carries this decoder, it must have arrived before we go away
+	{
+		std::unique_lock<std::mutex> guard(pipelineLock);
+		pipelineDone.wait(guard, [this] { return !pipelinePending; });
+	}
 
-	if (codec != nullptr)
+	if (codec)
 		codec->FlushJobs();
 
-	if (clip != nullptr)
-		clip->Release();
+	//every source detached, read ahead that never started has no target left
+	for (DecodeJob* job : queued)
+		delete job;
+	queued.clear();
+
+	compressedCache.reset();
 
-	if (codec != nullptr)
-		codec->Release();
+	//attributes before their clip, see ClipSegment
+	segments.clear();
 
-	if (factory != nullptr)
-		factory->Release();
+	config.reset();
+	codec.reset();
+	callback.reset();
+	factory.reset();
 }
 
 void BRAWSDKProcessor::getAudioSamples(void* buf, int64_t start, int64_t count) {
+	/* start is relative to the subclip, anything outside of it is silence and never read from the file */
+	const int64_t bytesPerSample = (int64_t)this->channelCount * this->audioBitDepth / 8;
+	uint8_t* dst = (uint8_t*)buf;
+
+	if (start < 0) {
+		int64_t silence = std::min(-start, count);
+		memset(dst, 0, (size_t)(silence * bytesPerSample));
+		dst += silence * bytesPerSample;
+		start += silence;
+		count -= silence;
+	}
+	int64_t available = std::max<int64_t>(rangeAudioSamples - start, 0);
+	if (count > available) {
+		memset(dst + available * bytesPerSample, 0, (size_t)((count - available) * bytesPerSample));
+		count = available;
+	}
+	if (count == 0)
+		return;
+
+	decoder->readAudio(dst, rangeAudioFirst + start, count);
+}
+
+void BRawDecoder::readAudio(uint8_t* dst, int64_t start, int64_t count) {
+	/* reads across file boundaries, each segment contributes its aligned span, missing samples are silence */
 	uint32_t samplesRead;
 	uint32_t bytesRead;
 	char buff[128] = {};
 
-	HRESULT result = audio->GetAudioSamples(start,
-		buf,
-		(count * this->channelCount * this->audioBitDepth) / 8,//samplebufsize
-		count,//maxsamplecount
-		&samplesRead,
-		&bytesRead);
-	if (result != S_OK) {
-		sprintf(buff, "Failed to GetAudioSamples!");
-		throw std::runtime_error(buff);
+	const int64_t bytesPerSample = (int64_t)this->channelCount * this->audioBitDepth / 8;
+
+	for (ClipSegment& segment : segments) {
+		if (count <= 0)
+			break;
+		int64_t segmentEnd = segment.firstAudioSample + segment.audioSpan;
+		if (start >= segmentEnd)
+			continue;
+		waitForOpen(segment);
+
+		int64_t local = start - segment.firstAudioSample;
+		int64_t wanted = std::min(count, segmentEnd - start);
+		int64_t real = std::max<int64_t>(std::min<int64_t>((int64_t)segment.audioSamples - local, wanted), 0);
+
+		if (real > 0) {
+			HRESULT result = segment.audio->GetAudioSamples(local,
+				dst,
+				(uint32_t)(real * bytesPerSample),//samplebufsize
+				(uint32_t)real,//maxsamplecount
+				&samplesRead,
+				&bytesRead);
+			if (result != S_OK) {
+				sprintf(buff, "Failed to GetAudioSamples!");
+				throw std::runtime_error(buff);
+			}
+		}
+		if (wanted > real)
+			memset(dst + real * bytesPerSample, 0, (size_t)((wanted - real) * bytesPerSample));
+
+		dst += wanted * bytesPerSample;
+		start += wanted;
+		count -= wanted;
 	}
+
+	if (count > 0)
+		memset(dst, 0, (size_t)(count * bytesPerSample));
 }
 
-bool* BRAWSDKProcessor::getFrameByNum(int frameNum, uint8_t * framebuffer) {
-	/* frame is returned in callback processcomplete */
-		
-	bool* signal_done = new bool; //avisynth sleeps until signal_done is set by ProcessComplete()
-	*signal_done = false;
+void BRAWSDKProcessor::setRange(unsigned long long first, unsigned long long last, unsigned long long step) {
 	char buff[128] = {};
+	if (first > last || last >= frameCount) {
+		sprintf(buff, "start/end must be within 0 and %llu with start <= end", frameCount - 1);
+		throw std::runtime_error(buff);
+	}
+	if (step < 1) {
+		sprintf(buff, "step must be 1 or more");
+		throw std::runtime_error(buff);
+	}
 
-	HRESULT result;
+	rangeFirst = first;
+	rangeStep = step;
+	rangeFrames = (last - first) / step + 1;
 
-	unsigned long long frameCount = 0;
-	unsigned long long frameIndex = frameNum;
+	//audio samples that belong to the frames of the range
+	double samplesPerFrame = (double)sampleRate * framerate_den / framerate_num;
+	rangeAudioFirst = std::min<int64_t>((int64_t)std::llround(first * samplesPerFrame), audioSamples);
+	int64_t audioEnd = std::min<int64_t>((int64_t)std::llround((last + 1) * samplesPerFrame), audioSamples);
+	rangeAudioSamples = std::max<int64_t>(audioEnd - rangeAudioFirst, 0);
+}
 
-	result = clip->GetFrameCount(&frameCount);
+long long BRAWSDKProcessor::frameForTimecode(const char* timecode) {
+	return decoder->frameForTimecode(timecode);
+}
 
-	IBlackmagicRawJob* jobRead = nullptr;
-	
-	CameraCodecCallback *callback = new CameraCodecCallback();
+long long BRawDecoder::frameForTimecode(const char* timecode) {
+	/* timecode HH:MM:SS:FF (or ;FF drop frame) to a frame number of the clip, relative to the timecode of the first frame */
+	char buff[128] = {};
+	int fps = (int)std::lround(framerate);
 
-	result = codec->SetCallback(callback);
-	if (result != S_OK)
-	{
-		sprintf(buff, "Failed to set IBlackmagicRawCallback!");
+	long long frames = 0;
+	if (!parseTimecode(timecode, fps, frames)) {
+		sprintf(buff, "cannot parse timecode %.32s, expected HH:MM:SS:FF or HH:MM:SS;FF at 29.97/59.94 fps", timecode);
 		throw std::runtime_error(buff);
 	}
-	unsigned long long findex = 0;
-	result = clip->CreateJobReadFrame(frameNum, &jobRead);
 
-	UserData* userData = nullptr;
-	if (result == S_OK)
-	{
-		userData = new UserData();
-		userData->frameIndex = frameIndex;
-		userData->job_done = signal_done;
-		userData->avs_framebuffer = framebuffer;
-		VERIFY(jobRead->SetUserData(userData));
+	SdkString startTimecode = nullptr;
+	long long startFrames = 0;
+	if (segments[0].clip->GetTimecodeForFrame(0, &startTimecode) == S_OK && startTimecode != nullptr) {
+		std::string start = fromSdkString(startTimecode);
+		parseTimecode(start.c_str(), fps, startFrames);
 	}
 
-	if (result == S_OK)
-		result = jobRead->Submit();
+	return frames - startFrames;
+}
+
+void BRawDecoder::pinWorkerThread() {
+	/* sdk worker threads only show up in our callbacks, so they get pinned the first time they call us.
+	   the copy stage runs on these threads too. only pages the frontend allocates fresh are first touched on this node,
+	   frames it recycles from its own cache stay where they were first touched */
+	thread_local BRawDecoder* pinnedFor = nullptr;
+	if (!pinThreads || pinnedFor == this)
+		return;
+
+	if (pinThread(workerAffinity))
+		Logger("pinned sdk worker thread");
+	pinnedFor = this;
+}
+
+HRESULT BRawDecoder::frameProcessingAttributes(IBlackmagicRawFrame* frame, SdkRef<IBlackmagicRawFrameProcessingAttributes>& attributes) {
+	/* only what the script sets is overridden, everything else keeps what the camera recorded for this frame.
+	   without overrides the sdk gets nullptr and uses the frame as it is */
+	bool frameSettings = options.setIso || options.setKelvin || options.setTint || options.setExposure;
+	if (!frameSettings)
+		return S_OK;
 
+	HRESULT result = frame->CloneFrameProcessingAttributes(attributes.put());
 	if (result != S_OK)
-	{
-		if (userData != nullptr)
-			delete userData;
+		return result;
 
-		if (jobRead != nullptr)
-			jobRead->Release();
+	VariantArg value;
+	if (result == S_OK && options.setIso) {
+		value.setU32(options.iso);
+		result = attributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeISO, value.get());
+	}
+	if (result == S_OK && options.setKelvin) {
+		value.setU32(options.kelvin);
+		result = attributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeWhiteBalanceKelvin, value.get());
+	}
+	if (result == S_OK && options.setTint) {
+		value.setS16((int16_t)options.tint);
+		result = attributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeWhiteBalanceTint, value.get());
+	}
+	if (result == S_OK && options.setExposure) {
+		value.setFloat(options.exposure);
+		result = attributes->SetFrameAttribute(blackmagicRawFrameProcessingAttributeExposure, value.get());
 	}
+	if (result != S_OK)
+		attributes.reset();
+	return result;
+}
 
-	++s_jobsInFlight;
+static bool addVariantNumber(VariantType type, const void* element, MetadataValue& value) {
+	/* one scalar or safe array element, the type tags differ between the windows and the linux sdk */
+	switch (type) {
+#ifdef _WIN32
+		case VT_UI1: value.ints.push_back(*(const uint8_t*)element); break;
+		case VT_I2: value.ints.push_back(*(const int16_t*)element); break;
+		case VT_UI2: value.ints.push_back(*(const uint16_t*)element); break;
+		case VT_I4: case VT_INT: value.ints.push_back(*(const int32_t*)element); break;
+		case VT_UI4: case VT_UINT: value.ints.push_back(*(const uint32_t*)element); break;
+		case VT_R4: value.floats.push_back(*(const float*)element); break;
+		case VT_R8: value.floats.push_back(*(const double*)element); break;
+#else
+		case blackmagicRawVariantTypeU8: value.ints.push_back(*(const uint8_t*)element); break;
+		case blackmagicRawVariantTypeS16: value.ints.push_back(*(const int16_t*)element); break;
+		case blackmagicRawVariantTypeU16: value.ints.push_back(*(const uint16_t*)element); break;
+		case blackmagicRawVariantTypeS32: value.ints.push_back(*(const int32_t*)element); break;
+		case blackmagicRawVariantTypeU32: value.ints.push_back(*(const uint32_t*)element); break;
+		case blackmagicRawVariantTypeFloat32: value.floats.push_back(*(const float*)element); break;
+		case blackmagicRawVariantTypeFloat64: value.floats.push_back(*(const double*)element); break;
+#endif
+		default: return false;
+	}
+	return true;
+}
 
-	frameIndex++;
-	
-	return signal_done;
-	//return result;
+static size_t variantElementSize(VariantType type) {
+	switch (type) {
+#ifdef _WIN32
+		case VT_UI1: return 1;
+		case VT_I2: case VT_UI2: return 2;
+		case VT_I4: case VT_INT: case VT_UI4: case VT_UINT: case VT_R4: return 4;
+		case VT_R8: return 8;
+#else
+		case blackmagicRawVariantTypeU8: return 1;
+		case blackmagicRawVariantTypeS16: case blackmagicRawVariantTypeU16: return 2;
+		case blackmagicRawVariantTypeS32: case blackmagicRawVariantTypeU32: case blackmagicRawVariantTypeFloat32: return 4;
+		case blackmagicRawVariantTypeFloat64: return 8;
+#endif
+		default: return 0;
+	}
 }
 
-HRESULT BRAWSDKProcessor::openFile(BSTR fileName, int bitmode) {
-	
-	HRESULT result = S_OK;
-	void* context = nullptr;
-	void* commandQueue = nullptr;
+static bool metadataFromVariant(const VARIANT& data, MetadataValue& value) {
+	/* scalars and safe arrays of numbers, everything else is skipped */
+	if (variantString(data, value.text)) {
+		value.type = MetadataValue::String;
+		return true;
+	}
 
-	char buff[128] = {};
+	if (variantIsArray(data)) {
+		VariantType type = (VariantType)0;
+		long lower = 0, upper = -1;
+		void* elements = nullptr;
+		SafeArrayGetVartype(data.parray, &type);
+		SafeArrayGetLBound(data.parray, 1, &lower);
+		SafeArrayGetUBound(data.parray, 1, &upper);
+		size_t elementSize = variantElementSize(type);
+		if (elementSize == 0 || SafeArrayAccessData(data.parray, &elements) != S_OK)
+			return false;
+
+		for (long i = 0; i <= upper - lower; i++)
+			addVariantNumber(type, (const uint8_t*)elements + i * elementSize, value);
+		SafeArrayUnaccessData(data.parray);
+		value.type = value.floats.empty() ? MetadataValue::Int : MetadataValue::Float;
+		return !value.ints.empty() || !value.floats.empty();
+	}
 
-	//in Avisynth environment, COM is already initialized
-	/*result = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	//all members of the variant union start at the same address
+	if (!addVariantNumber(data.vt, &data.dblVal, value))
+		return false;
+	value.type = value.floats.empty() ? MetadataValue::Int : MetadataValue::Float;
+	return true;
+}
+
+static void readMetadataIterator(IBlackmagicRawMetadataIterator* iterator, Metadata& metadata) {
+	//the iterator stays owned by the caller
+	if (iterator == nullptr)
+		return;
+
+	do {
+		SdkString key = nullptr;
+		VARIANT data;
+		VariantInit(&data);
+		if (iterator->GetKey(&key) == S_OK && key != nullptr) {
+			MetadataValue value;
+			value.key = fromSdkString(key);
+			if (iterator->GetData(&data) == S_OK && metadataFromVariant(data, value))
+				metadata.push_back(value);
+		}
+		VariantClear(&data);
+	} while (iterator->Next() == S_OK);
+}
+
+void BRawDecoder::readMetadata(DecodeJob& decoded, IBlackmagicRawFrame* frame) {
+	/* per frame values come from the frame the read job already loaded, the clip values are parsed
+	   once per file and shared by all frames */
+	if (!decoded.metadata)
+		return;
+
+	ClipSegment& segment = segments[segmentForFrame(decoded.frameIndex)];
+	{
+		std::lock_guard<std::mutex> guard(metadataLock);
+		if (!segment.metadata) {
+			auto clipMetadata = std::make_shared<Metadata>();
+			SdkRef<IBlackmagicRawMetadataIterator> iterator;
+			if (segment.clip->GetMetadataIterator(iterator.put()) == S_OK)
+				readMetadataIterator(iterator.get(), *clipMetadata);
+			segment.metadata = clipMetadata;
+		}
+		decoded.clipMetadata = segment.metadata;
+	}
+
+	SdkString timecode = nullptr;
+	if (frame->GetTimecode(&timecode) == S_OK && timecode != nullptr)
+		decoded.timecode = fromSdkString(timecode);
+
+	SdkRef<IBlackmagicRawMetadataIterator> iterator;
+	if (frame->GetMetadataIterator(iterator.put()) == S_OK)
+		readMetadataIterator(iterator.get(), decoded.frameMetadata);
+}
+
+void BRawDecoder::buildClipAttributes(ClipSegment& segment) {
+	/* gamma and gamut are clip wide, invalid names are reported right away */
+	char buff[256] = {};
+	if (options.gamma.empty() && options.gamut.empty())
+		return;
+
+	HRESULT result = segment.clip->CloneClipProcessingAttributes(segment.clipAttributes.put());
 	if (result != S_OK)
 	{
-		sprintf(buff, "COM init failed, HRESULT %d",result);
+		sprintf(buff, "Failed to get clip processing attributes of %.128s", segment.fileName.c_str());
 		throw std::runtime_error(buff);
-	}*/
+	}
 
-	//decide bitmode
-	switch (bitmode){
-		case 8: 
-			s_resourceFormat = blackmagicRawResourceFormatBGRAU8;
-			break;		
-		case 16:
-			s_resourceFormat = blackmagicRawResourceFormatRGBU16Planar;
-			break;
-		case 32: 
-			s_resourceFormat = blackmagicRawResourceFormatRGBF32Planar;
-			break;
-		
-		default:{
-			sprintf(buff, "only 8 or 32 bit output supported!");
+	VariantArg value;
+	if (!options.gamma.empty()) {
+		value.setString(options.gamma);
+		result = segment.clipAttributes->SetClipAttribute(blackmagicRawClipProcessingAttributeGamma, value.get());
+		if (result != S_OK)
+		{
+			sprintf(buff, "gamma \"%.64s\" is not supported by this clip, e.g. use \"Blackmagic Design Film\" or \"Rec.709\"", options.gamma.c_str());
+			throw std::runtime_error(buff);
+		}
+	}
+	if (!options.gamut.empty()) {
+		value.setString(options.gamut);
+		result = segment.clipAttributes->SetClipAttribute(blackmagicRawClipProcessingAttributeGamut, value.get());
+		if (result != S_OK)
+		{
+			sprintf(buff, "gamut \"%.64s\" is not supported by this clip, e.g. use \"Blackmagic Design\" or \"Rec.709\"", options.gamut.c_str());
 			throw std::runtime_error(buff);
 		}
 	}
+}
 
-	/* get path of current dll (BRawsource.dll) as base for locating blackmagicapi dll*/
-	TCHAR   DllPath[MAX_PATH] = { 0 };
-	GetModuleFileName((HINSTANCE)&__ImageBase, DllPath, _countof(DllPath));
+size_t BRAWSDKProcessor::frameSizeBytes() {
+	switch (resourceFormat) {
+		case blackmagicRawResourceFormatRGBU16Planar:
+			return (size_t)width * height * 6;
+		case blackmagicRawResourceFormatRGBF32Planar:
+			return (size_t)width * height * 12;
+		default:
+			return (size_t)width * height * 4;
+	}
+}
 
-	_bstr_t bstr = _bstr_t(DllPath);
-	std::string helperstring = bstr;
-	std::string pathname = helperstring.substr(0,helperstring.find_last_of("\\") + 1);
-	pathname = pathname.append("brawsource_dlls");
+CompressedCache::CompressedCache(uint64_t budgetBytes) {
+	//never more than an eighth of the physical memory, the decoded frames need the rest
+	uint64_t totalBytes = 0, availableBytes = 0;
+	if (systemMemory(totalBytes, availableBytes))
+		budgetBytes = std::min(budgetBytes, totalBytes / 8);
+	budget = budgetBytes;
 
-	BSTR libraryPath = _bstr_t(pathname.c_str());
-	factory = CreateBlackmagicRawFactoryInstanceFromPath(libraryPath);
-	SysFreeString(libraryPath);
-	if (factory == nullptr)
-	{
-		sprintf(buff, "Failed to create IBlackmagicRawFactory, did you place brawsource_dlls folder next to this dll`?");
-		throw std::runtime_error(buff);
+	Pool& shared = pool();
+	std::lock_guard<std::mutex> guard(shared.lock);
+	shared.budgets.insert(budget);
+}
+
+CompressedCache::~CompressedCache() {
+	Pool& shared = pool();
+	std::lock_guard<std::mutex> guard(shared.lock);
+	for (auto& entry : entries) {
+		shared.bytes -= entry.second.bytes;
+		shared.useOrder.erase(entry.second.use);
 	}
+	entries.clear();
+	shared.budgets.erase(shared.budgets.find(budget));
+	evict(shared);
+}
 
-	result = factory->CreateCodec(&codec);
-	if (result != S_OK)
-	{
-		sprintf(buff, "Failed to create IBlackmagicRaw, this is unexpected, i don't know what could cause it!");
-		throw std::runtime_error(buff);
+CompressedCache::Pool& CompressedCache::pool() {
+	static Pool shared;
+	return shared;
+}
+
+void CompressedCache::evict(Pool& shared) {
+	uint64_t limit = shared.budgets.empty() ? 0 : *shared.budgets.rbegin();
+	while (shared.bytes > limit && !shared.useOrder.empty()) {
+		CompressedCache* owner = shared.useOrder.back().first;
+		auto oldest = owner->entries.find(shared.useOrder.back().second);
+		shared.bytes -= oldest->second.bytes;
+		owner->current.bytes -= oldest->second.bytes;
+		owner->entries.erase(oldest);
+		owner->current.frames = owner->entries.size();
+		shared.useOrder.pop_back();
 	}
+}
 
-	result = codec->OpenClip(fileName, &clip);
-		
-	if (result != S_OK)
-	{
-		sprintf(buff, "Failed to open IBlackmagicRawClip, is it in braw format?");
+void CompressedCache::put(unsigned long long frameIndex, IBlackmagicRawFrame* frame) {
+	uint32_t bytes = 0;
+	SdkRef<IBlackmagicRawFrameEx> frameEx;
+	if (frame->QueryInterface(IID_IBlackmagicRawFrameEx, frameEx.putVoid()) == S_OK)
+		frameEx->GetBitStreamSizeBytes(&bytes);
+	if (bytes == 0 || bytes > budget)
+		return;
+
+	Pool& shared = pool();
+	std::lock_guard<std::mutex> guard(shared.lock);
+	if (entries.count(frameIndex))
+		return;
+
+	shared.useOrder.emplace_front(this, frameIndex);
+	Entry& entry = entries[frameIndex];
+	entry.frame = SdkRef<IBlackmagicRawFrame>::share(frame);
+	entry.bytes = bytes;
+	entry.use = shared.useOrder.begin();
+	current.bytes += bytes;
+	current.frames = entries.size();
+	shared.bytes += bytes;
+
+	evict(shared);
+}
+
+SdkRef<IBlackmagicRawFrame> CompressedCache::get(unsigned long long frameIndex) {
+	Pool& shared = pool();
+	std::lock_guard<std::mutex> guard(shared.lock);
+	auto found = entries.find(frameIndex);
+	if (found == entries.end())
+		return SdkRef<IBlackmagicRawFrame>();
+
+	shared.useOrder.splice(shared.useOrder.begin(), shared.useOrder, found->second.use);
+	current.hits++;
+	return found->second.frame;
+}
+
+CompressedCacheStats CompressedCache::stats() {
+	Pool& shared = pool();
+	std::lock_guard<std::mutex> guard(shared.lock);
+	return current;
+}
+
+CompressedCacheStats BRawDecoder::compressedCacheStats() {
+	return compressedCache ? compressedCache->stats() : CompressedCacheStats();
+}
+
+FileReadStats BRawDecoder::fileReadStats() {
+	return fileReadAhead ? fileReadAhead->stats() : FileReadStats();
+}
+
+size_t BRAWSDKProcessor::maxHeldFrames() {
+	/* read ahead and cache at their limits, or all sampled frames (Thumbs) pinned by warmUp, plus the
+	   frame being requested */
+	size_t frames = 3 * s_maxReadAhead;
+	if (rangeStep > 1)
+		frames = std::max<size_t>(frames, rangeFrames);
+	return std::min<size_t>(frames, std::max<size_t>(governor->budgetFrames(), 1)) + 1;
+}
+
+CompressedCacheStats BRAWSDKProcessor::compressedCacheStats() {
+	return decoder->compressedCacheStats();
+}
+
+QcStats BRAWSDKProcessor::qcSummary() {
+	std::lock_guard<std::mutex> guard(fetchLock);
+	return clipQc;
+}
+
+PrefetchStats BRAWSDKProcessor::prefetchStats() {
+	return governor->stats();
+}
+
+FileReadStats BRAWSDKProcessor::fileReadStats() {
+	return decoder->fileReadStats();
+}
+
+void BRAWSDKProcessor::applyLut(const uint8_t* const src[3], uint8_t* const dst[3], uint32_t count) {
+	if (resourceFormat == blackmagicRawResourceFormatBGRAU8)
+		lut->applyBGRA8(src[0], dst[0], count);
+	else if (resourceFormat == blackmagicRawResourceFormatRGBU16Planar)
+		lut->applyPlanarU16((const uint16_t* const*)src, (uint16_t* const*)dst, count);
+	else
+		lut->applyPlanarF32((const float* const*)src, (float* const*)dst, count);
+}
+
+static int formatBits(BlackmagicRawResourceFormat format) {
+	switch (format) {
+		case blackmagicRawResourceFormatRGBU16Planar:
+			return 16;
+		case blackmagicRawResourceFormatRGBF32Planar:
+			return 32;
+		default:
+			return 8;
+	}
+}
+
+static int scaleDivisor(BlackmagicRawResolutionScale scale) {
+	switch (scale) {
+		case blackmagicRawResolutionScaleHalf:
+			return 2;
+		case blackmagicRawResolutionScaleQuarter:
+			return 4;
+		case blackmagicRawResolutionScaleEighth:
+			return 8;
+		default:
+			return 1;
+	}
+}
+
+static inline uint8_t unitToU8(float value) {
+	value = value * 255.0f + 0.5f;
+	return (uint8_t)(value < 0 ? 0 : (value > 255.0f ? 255.0f : value));
+}
+
+static void convertRow(const uint8_t* const src[3], int srcBits, uint8_t* const dst[3], int dstBits, uint32_t count) {
+	/* planar R,G,B of a decode shared with a source of more bits into the format of this source,
+	   only ever to fewer bits. 8 bit is interleaved BGRA like the sdk delivers it */
+	if (dstBits == 16) {
+		for (int p = 0; p < 3; p++) {
+			const float* s = (const float*)src[p];
+			uint16_t* d = (uint16_t*)dst[p];
+			for (uint32_t x = 0; x < count; x++) {
+				float value = s[x] * 65535.0f + 0.5f;
+				d[x] = (uint16_t)(value < 0 ? 0 : (value > 65535.0f ? 65535.0f : value));
+			}
+		}
+		return;
+	}
+
+	uint8_t* d = dst[0];
+	if (srcBits == 16) {
+		const uint16_t* r = (const uint16_t*)src[0];
+		const uint16_t* g = (const uint16_t*)src[1];
+		const uint16_t* b = (const uint16_t*)src[2];
+		//v / 257 rounded
+		for (uint32_t x = 0; x < count; x++, d += 4) {
+			d[0] = (uint8_t)(((uint32_t)b[x] * 255 + 32895) >> 16);
+			d[1] = (uint8_t)(((uint32_t)g[x] * 255 + 32895) >> 16);
+			d[2] = (uint8_t)(((uint32_t)r[x] * 255 + 32895) >> 16);
+			d[3] = 255;
+		}
+		return;
+	}
+
+	const float* r = (const float*)src[0];
+	const float* g = (const float*)src[1];
+	const float* b = (const float*)src[2];
+	for (uint32_t x = 0; x < count; x++, d += 4) {
+		d[0] = unitToU8(b[x]);
+		d[1] = unitToU8(g[x]);
+		d[2] = unitToU8(r[x]);
+		d[3] = 255;
+	}
+}
+
+static void qcRow(QcStats& qc, int bits, uint8_t* const rows[3], uint32_t count) {
+	if (bits == 8)
+		qc.addBGRA8(rows[0], count);
+	else if (bits == 16)
+		qc.addPlanarU16((const uint16_t* const*)rows, count);
+	else
+		qc.addPlanarF32((const float* const*)rows, count);
+}
+
+void BRAWSDKProcessor::copyToOutput(const uint8_t* src, BlackmagicRawResourceFormat srcFormat, const Geometry& g, OutputFrame& out, QcStats* qc) {
+	/* copies the used region of the processed image into the frontend buffer, honours the destination pitch
+	   (negative for bottom up frames, so no flip is needed later). resize, conversion from a shared decode of
+	   more bits and LUT are done on the way, the planes are walked row by row together and every output row
+	   is written once. qc reads each row right after it was written, while it is still in cache */
+	static const Resampler::Format s_formats[] = { Resampler::U8, Resampler::U16, Resampler::F32 };
+	const int srcBits = formatBits(srcFormat);
+	const int dstBits = formatBits(resourceFormat);
+	const int srcPlanes = srcBits == 8 ? 1 : 3;
+	const size_t srcPixel = srcBits == 8 ? 4 : srcBits / 8;
+	const int dstPlanes = std::min(dstBits == 8 ? 1 : 3, out.numPlanes);
+	const size_t dstPixel = dstBits == 8 ? 4 : dstBits / 8;
+	const bool convert = srcBits != dstBits;
+
+	const size_t srcPitch = (size_t)g.decodeWidth * srcPixel;
+	const size_t srcPlaneBytes = srcPitch * g.decodeHeight;
+	const size_t rowBytes = (size_t)width * dstPixel;
+
+	if (g.resampler) {
+		std::vector<Resampler::Plane> planes;
+		for (int p = 0; p < srcPlanes; p++)
+			planes.emplace_back(*g.resampler, s_formats[srcBits / 16], srcPlanes == 1 ? 4 : 1, src + p * srcPlaneBytes, (ptrdiff_t)srcPitch);
+
+		//resampled rows in the processed format, when they still have to be converted
+		std::vector<uint8_t> resampled(convert ? (size_t)width * srcPixel * srcPlanes : 0);
+
+		for (uint32_t y = 0; y < height; y++) {
+			uint8_t* dstRow[3];
+			for (int p = 0; p < dstPlanes; p++)
+				dstRow[p] = out.planes[p] + (ptrdiff_t)y * out.pitches[p];
+			if (convert) {
+				uint8_t* srcRow[3];
+				for (int p = 0; p < srcPlanes; p++) {
+					srcRow[p] = resampled.data() + p * (size_t)width * srcPixel;
+					planes[p].row(y, srcRow[p]);
+				}
+				convertRow(srcRow, srcBits, dstRow, dstBits, width);
+			}
+			else {
+				for (int p = 0; p < dstPlanes; p++)
+					planes[p].row(y, dstRow[p]);
+			}
+			//in place, the row is still in cache
+			if (lut)
+				applyLut(dstRow, dstRow, width);
+			if (qc)
+				qcRow(*qc, dstBits, dstRow, width);
+		}
+		return;
+	}
+
+	const size_t roiOffset = g.roiTop * srcPitch + g.roiLeft * srcPixel;
+	if (lut || convert) {
+		for (uint32_t y = 0; y < height; y++) {
+			const uint8_t* srcRow[3];
+			uint8_t* dstRow[3];
+			for (int p = 0; p < srcPlanes; p++)
+				srcRow[p] = src + p * srcPlaneBytes + roiOffset + y * srcPitch;
+			for (int p = 0; p < dstPlanes; p++)
+				dstRow[p] = out.planes[p] + (ptrdiff_t)y * out.pitches[p];
+			if (!convert) {
+				applyLut(srcRow, dstRow, width);
+			}
+			else {
+				convertRow(srcRow, srcBits, dstRow, dstBits, width);
+				if (lut)
+					applyLut(dstRow, dstRow, width);
+			}
+			if (qc)
+				qcRow(*qc, dstBits, dstRow, width);
+		}
+		return;
+	}
+
+	if (qc) {
+		//all planes of a row together for luma
+		for (uint32_t y = 0; y < height; y++) {
+			uint8_t* dstRow[3];
+			for (int p = 0; p < dstPlanes; p++) {
+				dstRow[p] = out.planes[p] + (ptrdiff_t)y * out.pitches[p];
+				memcpy(dstRow[p], src + p * srcPlaneBytes + roiOffset + y * srcPitch, rowBytes);
+			}
+			qcRow(*qc, dstBits, dstRow, width);
+		}
+		return;
+	}
+
+	for (int p = 0; p < dstPlanes; p++) {
+		const uint8_t* srcp = src + p * srcPlaneBytes + roiOffset;
+		uint8_t* dstp = out.planes[p];
+		if (out.pitches[p] > 0 && (size_t)out.pitches[p] == srcPitch && rowBytes == srcPitch) {
+			memcpy(dstp, srcp, rowBytes * height);
+			continue;
+		}
+		for (uint32_t y = 0; y < height; y++) {
+			memcpy(dstp, srcp, rowBytes);
+			srcp += srcPitch;
+			dstp += out.pitches[p];
+		}
+	}
+}
+
+void BRAWSDKProcessor::chooseGeometry() {
+	/* decides the decode scale this source needs, the region of the recorded picture and the output size.
+	   with resize the smallest decode that still has the output size inside the region is taken, the sdk
+	   then does a fraction of the work. not every clip has every scale (depends on camera and codec).
+	   width and height become the output size */
+	char buff[160] = {};
+	if (options.scale != 1 && options.scale != 2 && options.scale != 4 && options.scale != 8) {
+		sprintf(buff, "scale must be 1, 2, 4 or 8");
 		throw std::runtime_error(buff);
 	}
 
-	//in bmd example, codec->SetCallback(&callback); is done here but as we add "userdata" dynamically, we do that in getFrameByNum
+	//crop in recorded pixels
+	const uint32_t fullWidth = width;
+	const uint32_t fullHeight = height;
+	int left = 0, top = 0, cropWidth = (int)fullWidth, cropHeight = (int)fullHeight;
+	if (options.crop) {
+		left = options.cropLeft;
+		top = options.cropTop;
+		cropWidth = options.cropWidth > 0 ? options.cropWidth : (int)fullWidth - left + options.cropWidth;
+		cropHeight = options.cropHeight > 0 ? options.cropHeight : (int)fullHeight - top + options.cropHeight;
+		if (left < 0 || top < 0 || cropWidth <= 0 || cropHeight <= 0 || left + cropWidth > (int)fullWidth || top + cropHeight > (int)fullHeight) {
+			sprintf(buff, "crop %d,%d,%d,%d is outside of the %ux%u picture", options.cropLeft, options.cropTop, options.cropWidth, options.cropHeight, fullWidth, fullHeight);
+			throw std::runtime_error(buff);
+		}
+	}
+
+	resize = options.resizeWidth > 0 || options.resizeHeight > 0;
+	int outWidth = cropWidth;
+	int outHeight = cropHeight;
+	if (resize) {
+		outWidth = options.resizeWidth > 0 ? options.resizeWidth : (int)std::lround((double)cropWidth * options.resizeHeight / cropHeight);
+		outHeight = options.resizeHeight > 0 ? options.resizeHeight : (int)std::lround((double)cropHeight * options.resizeWidth / cropWidth);
+		outWidth = std::max(outWidth, 1);
+		outHeight = std::max(outHeight, 1);
+	}
 
-	//analyze clip props
-	result = clip->GetFrameCount(&this->frameCount);
-	result = clip->GetWidth(&this->width);
-	result = clip->GetHeight(&this->height);
-	result = clip->GetFrameRate(&this->framerate);
-	
-	//hackily try to get fraction from framerate float, bmd skd does not seem to provide num and den
-	floatToFraction(this->framerate, this->framerate_num, this->framerate_den);
+	static const struct { int divisor; BlackmagicRawResolutionScale scale; } s_scales[] = {
+		{ 8, blackmagicRawResolutionScaleEighth },
+		{ 4, blackmagicRawResolutionScaleQuarter },
+		{ 2, blackmagicRawResolutionScaleHalf },
+	};
+
+	resolutionScale = blackmagicRawResolutionScaleFull;
+	decodeWidth = fullWidth;
+	decodeHeight = fullHeight;
+	SdkRef<IBlackmagicRawClipResolutions> resolutions;
+	if ((options.scale > 1 || resize) && decoder->segments[0].clip->QueryInterface(IID_IBlackmagicRawClipResolutions, resolutions.putVoid()) != S_OK)
+		resolutions.reset();
+
+	for (int i = 0; i < 3 && resolutions; i++) {
+		if (options.scale > 1 && s_scales[i].divisor != options.scale)
+			continue;
+		uint32_t w = 0, h = 0;
+		if (resolutions->GetClosestResolutionForScale(s_scales[i].scale, &w, &h) != S_OK || w == 0 || h == 0)
+			continue;
+		//a decode smaller than the output would only be blown up again
+		if (options.scale == 1 && ((double)cropWidth * w / fullWidth < outWidth || (double)cropHeight * h / fullHeight < outHeight))
+			continue;
+		resolutionScale = s_scales[i].scale;
+		decodeWidth = w;
+		decodeHeight = h;
+		break;
+	}
 
-	result = clip->QueryInterface(IID_IBlackmagicRawClipAudio, (void**)&audio);
-	
-	if (result != S_OK)
-	{
-		sprintf(buff, "Could not init Audioreader using BMD SDK!");
+	if (options.scale > 1 && resolutionScale == blackmagicRawResolutionScaleFull) {
+		sprintf(buff, "this clip can not be decoded at 1/%d resolution", options.scale);
 		throw std::runtime_error(buff);
 	}
 
-	result = audio->GetAudioSampleCount(&this->audioSamples);
-	result = audio->GetAudioBitDepth(&this->audioBitDepth);
-	result = audio->GetAudioChannelCount(&this->channelCount);
-	result = audio->GetAudioSampleRate(&this->sampleRate);
+	this->cropLeft = left;
+	this->cropTop = top;
+	this->cropWidth = cropWidth;
+	this->cropHeight = cropHeight;
+
+	//without resize the output is the region at the decoded size
+	if (!resize) {
+		uint32_t roiLeft = (uint32_t)std::lround(left * (double)decodeWidth / fullWidth);
+		uint32_t roiTop = (uint32_t)std::lround(top * (double)decodeHeight / fullHeight);
+		outWidth = std::min((int)std::lround(cropWidth * (double)decodeWidth / fullWidth), (int)(decodeWidth - roiLeft));
+		outHeight = std::min((int)std::lround(cropHeight * (double)decodeHeight / fullHeight), (int)(decodeHeight - roiTop));
+	}
+
+	width = outWidth;
+	height = outHeight;
+}
+
+std::shared_ptr<const BRAWSDKProcessor::Geometry> BRAWSDKProcessor::geometryFor(uint32_t w, uint32_t h) {
+	/* the region in a processed image of this size, built once per size. a decode shared with another source
+	   may be larger than what this one asked for, it is then resampled to the output size. sources attaching
+	   and detaching change the decoded size, so every size seen is kept */
+	std::lock_guard<std::mutex> guard(geometryLock);
+	std::shared_ptr<const Geometry>& geometry = geometries[std::make_pair(w, h)];
+	if (geometry)
+		return geometry;
+
+	auto g = std::make_shared<Geometry>();
+	g->decodeWidth = w;
+	g->decodeHeight = h;
+
+	double scaleX = (double)w / decoder->width;
+	double scaleY = (double)h / decoder->height;
+	double regionLeft = cropLeft * scaleX, regionTop = cropTop * scaleY;
+	double regionWidth = cropWidth * scaleX, regionHeight = cropHeight * scaleY;
+	g->roiLeft = (uint32_t)std::lround(regionLeft);
+	g->roiTop = (uint32_t)std::lround(regionTop);
+
+	//an exact region of the output size is a plain copy, as is the size this source decodes at without resize
+	bool exact = regionLeft == g->roiLeft && regionTop == g->roiTop && regionWidth == width && regionHeight == height;
+	bool own = !resize && w == decodeWidth && h == decodeHeight;
+	if (!exact && !own)
+		g->resampler = std::make_shared<Resampler>(w, h, regionLeft, regionTop, regionWidth, regionHeight, width, height);
+
+	geometry = g;
+	return g;
+}
+
+void BRAWSDKProcessor::loadLut() {
+	/* the embedded LUT comes from the clip processing attributes of the first file */
+	char buff[256] = {};
+	if (options.lut.empty())
+		return;
+
+	if (options.lut == "embedded") {
+		SdkRef<IBlackmagicRawClipProcessingAttributes> attributes = decoder->segments[0].clipAttributes;
+		if (!attributes && decoder->segments[0].clip->CloneClipProcessingAttributes(attributes.put()) != S_OK)
+			attributes.reset();
+
+		SdkRef<IBlackmagicRawPost3DLUT> embedded;
+		uint32_t lutSize = 0;
+		uint32_t lutBytes = 0;
+		void* data = nullptr;
+		if (attributes && attributes->GetPost3DLUT(embedded.put()) == S_OK && embedded) {
+			embedded->GetSize(&lutSize);
+			embedded->GetResourceSizeBytes(&lutBytes);
+			embedded->GetResourceCPU(&data);
+		}
+
+		size_t entries = (size_t)lutSize * lutSize * lutSize;
+		if (data != nullptr && lutSize >= 2 && (lutBytes == entries * 3 * sizeof(float) || lutBytes == entries * 4 * sizeof(float)))
+			lut = Lut3D::fromTable((const float*)data, lutSize, lutBytes / (int)(entries * sizeof(float)));
+
+		if (!lut) {
+			sprintf(buff, "%.128s has no embedded 3D LUT", decoder->segments[0].fileName.c_str());
+			throw std::runtime_error(buff);
+		}
+	}
+	else {
+		lut = Lut3D::fromCubeFile(options.lut);
+	}
+
+	if (resourceFormat == blackmagicRawResourceFormatBGRAU8)
+		lut->prepareShaper(8);
+	if (resourceFormat == blackmagicRawResourceFormatRGBU16Planar)
+		lut->prepareShaper(16);
+}
+
+void BRAWSDKProcessor::frameProcessed(std::shared_ptr<DecodedFrame>& frame, const DecodeJob& job, HRESULT result, IBlackmagicRawProcessedImage* img) {
+
+	if (result == S_OK && img != nullptr) {
+		uint32_t w, h;
+		void* imageData = nullptr;
+		img->GetWidth(&w);
+		img->GetHeight(&h);
+		result = img->GetResource(&imageData);
+		std::shared_ptr<const Geometry> g;
+		if (result == S_OK)
+			g = geometryFor(w, h);
+		//a plain copy reads a region of the output size, it must be inside of the image
+		if (result == S_OK && !g->resampler && (g->roiLeft + width > w || g->roiTop + height > h))
+			result = E_UNEXPECTED;
+		if (result == S_OK)
+			copyToOutput((const uint8_t*)imageData, job.format, *g, *frame->output, options.qc ? &frame->qc : nullptr);
+		if (result == S_OK && options.qc)
+			frame->qc.frames = 1;
+	}
+
+	//what the read found, the same for every source of the job
+	frame->readMs = job.readMs;
+	frame->compressedHit = job.compressedHit;
+	frame->sharedDecode = job.targets.size() > 1;
+	frame->settingsRejected = job.settingsRejected;
+	if (options.metadata) {
+		frame->timecode = job.timecode;
+		frame->frameMetadata = job.frameMetadata;
+		frame->clipMetadata = job.clipMetadata;
+	}
+
+	double decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame->submitted).count();
+
+	{
+		std::lock_guard<std::mutex> guard(fetchLock);
+		frame->result = result;
+		frame->done = true;
+	}
+	frameDone.notify_all();
+
+	if (result == S_OK)
+		governor->onDecoded(decodeMs);
+}
+
+void BRawDecoder::jobDone(DecodeJob* job, HRESULT result, IBlackmagicRawProcessedImage* img) {
+	/* nobody can join anymore once the copies start, a source that goes away meanwhile waits for its copy */
+	std::unique_ptr<DecodeJob> owned(job);
+	std::vector<DecodeJob::Target> targets;
+	{
+		std::lock_guard<std::mutex> guard(jobLock);
+		auto range = jobs.equal_range(job->frameIndex);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == job) {
+				jobs.erase(it);
+				break;
+			}
+		}
+		targets = job->targets;
+		for (DecodeJob::Target& target : targets)
+			copying[target.output]++;
+		if (job->started)
+			startedJobs--;
+	}
+
+	for (DecodeJob::Target& target : targets)
+		target.output->frameProcessed(target.frame, *job, result, img);
+
+	//our references to the frames go before the sources are released, detach returning means no sdk thread
+	//frees a frame of that source (and a frontend frame in it) anymore
+	std::vector<BRAWSDKProcessor*> outputs;
+	for (DecodeJob::Target& target : targets)
+		outputs.push_back(target.output);
+	targets.clear();
+	job->targets.clear();
+
+	{
+		std::lock_guard<std::mutex> guard(jobLock);
+		for (BRAWSDKProcessor* output : outputs) {
+			if (--copying[output] == 0)
+				copying.erase(output);
+		}
+	}
+	jobCopied.notify_all();
+	owned.reset();
+
+	//the sdk has room for the next queued read ahead
+	startQueued();
+}
+
+size_t BRawDecoder::segmentForFrame(unsigned long long frame) {
+	auto next = std::upper_bound(segments.begin(), segments.end(), frame, [](unsigned long long f, const ClipSegment& segment) {
+		return f < segment.firstFrame;
+	});
+	return next == segments.begin() ? 0 : (size_t)(next - segments.begin()) - 1;
+}
+
+HRESULT BRawDecoder::decodeFrame(DecodeJob* job, IBlackmagicRawFrame* frame) {
+	/* second half of a frame, after the read job or straight from the compressed cache. on success the sdk
+	   decode job carries the job until ProcessComplete, on failure the caller still owns it */
+	SdkRef<IBlackmagicRawJob> decodeAndProcessJob;
+	HRESULT result = S_OK;
+
+	if (compressedCache && !job->compressedHit)
+		compressedCache->put(job->frameIndex, frame);
+
+	readMetadata(*job, frame);
+
+	VERIFY(frame->SetResourceFormat(job->format));//forces output format and bits, must be set for avisynth operation, we dont support 1:1 formats
+
+	//reduced resolution decode, the sdk skips most of the work instead of scaling down afterwards
+	if (job->scale != blackmagicRawResolutionScaleFull)
+		result = frame->SetResolutionScale(job->scale);
+
+	//raw settings of the script: gamma and gamut once per clip, iso and white balance on top of the settings of this frame
+	IBlackmagicRawClipProcessingAttributes* clipAttributes = segments[segmentForFrame(job->frameIndex)].clipAttributes.get();
+	if (result == S_OK) {
+		result = frameProcessingAttributes(frame, job->frameAttributes);
+		job->settingsRejected = result != S_OK;
+	}
+
+	Logger("start CreateJobDecodeAndProcessFrame");
+	if (result == S_OK)
+		result = frame->CreateJobDecodeAndProcessFrame(clipAttributes, job->frameAttributes.get(), decodeAndProcessJob.put());
+	Logger("created CreateJobDecodeAndProcessFrame");
+
+	if (result == S_OK)
+		VERIFY(decodeAndProcessJob->SetUserData(job));
+
+	if (result == S_OK)
+		result = decodeAndProcessJob->Submit();
+
+	Logger("decodeAndProcessJob->Submit() done");
+
+	//from now on ProcessComplete owns the sdk job
+	if (result == S_OK)
+		decodeAndProcessJob.detach();
+
+	return result;
+}
+
+void BRawDecoder::attach(BlackmagicRawResourceFormat format, BlackmagicRawResolutionScale scale, bool metadata) {
+	/* jobs submitted from now on decode in the widest format and at the largest scale of all sources */
+	std::lock_guard<std::mutex> guard(jobLock);
+	if (formatBits(format) > formatBits(resourceFormat))
+		resourceFormat = format;
+	if (scaleDivisor(scale) < scaleDivisor(resolutionScale))
+		resolutionScale = scale;
+	this->metadata = this->metadata || metadata;
+}
+
+void BRawDecoder::detach(BRAWSDKProcessor* output) {
+	std::unique_lock<std::mutex> guard(jobLock);
+	for (auto& job : jobs) {
+		std::vector<DecodeJob::Target>& targets = job.second->targets;
+		targets.erase(std::remove_if(targets.begin(), targets.end(), [output](const DecodeJob::Target& target) {
+			return target.output == output;
+		}), targets.end());
+	}
+
+	//queued read ahead only of this source is never started
+	std::vector<DecodeJob*> orphans;
+	for (DecodeJob* job : queued) {
+		if (job->targets.empty())
+			orphans.push_back(job);
+	}
+	for (DecodeJob* job : orphans)
+		dropQueued(job);
+
+	jobCopied.wait(guard, [this, output] { return copying.count(output) == 0; });
+}
+
+void BRawDecoder::dropQueued(DecodeJob* job) {
+	/* called with jobLock held, the job was never handed to the sdk */
+	queued.erase(std::find(queued.begin(), queued.end(), job));
+	auto range = jobs.equal_range(job->frameIndex);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == job) {
+			jobs.erase(it);
+			break;
+		}
+	}
+	delete job;
+}
+
+HRESULT BRawDecoder::startJob(DecodeJob* job) {
+	/* hands the job to the sdk, called with jobLock held. on failure nothing was submitted and the job is unchanged */
+	HRESULT result = S_OK;
+	job->submitted = std::chrono::steady_clock::now();
+	for (DecodeJob::Target& target : job->targets)
+		target.frame->submitted = job->submitted; //decode time for the governor starts here, not in our queue
+
+	//still compressed in memory, only the decode is left to do
+	SdkRef<IBlackmagicRawFrame> cached;
+	if (compressedCache)
+		cached = compressedCache->get(job->frameIndex);
+	if (cached) {
+		job->compressedHit = true;
+		result = decodeFrame(job, cached.get());
+		if (result != S_OK)
+			job->compressedHit = false;
+	}
+	else {
+		SdkRef<IBlackmagicRawJob> jobRead;
+		ClipSegment& segment = segments[segmentForFrame(job->frameIndex)];
+		result = segment.clip->CreateJobReadFrame(job->frameIndex - segment.firstFrame, jobRead.put());
+
+		if (result == S_OK)
+			VERIFY(jobRead->SetUserData(job));
+
+		if (result == S_OK)
+			result = jobRead->Submit();
+
+		//from now on ReadComplete owns the sdk job
+		if (result == S_OK)
+			jobRead.detach();
+	}
+
+	if (result == S_OK) {
+		job->started = true;
+		startedJobs++;
+	}
+	return result;
+}
+
+void BRawDecoder::startQueued() {
+	/* oldest read ahead first while the sdk has room, a job that fails to start completes with the error */
+	for (;;) {
+		DecodeJob* job = nullptr;
+		HRESULT result = S_OK;
+		{
+			std::lock_guard<std::mutex> guard(jobLock);
+			if (queued.empty() || startedJobs >= s_maxStartedJobs)
+				return;
+			job = queued.front();
+			queued.pop_front();
+			result = startJob(job);
+		}
+		if (result != S_OK)
+			jobDone(job, result, nullptr);
+	}
+}
+
+HRESULT BRawDecoder::submit(BRAWSDKProcessor* output, std::shared_ptr<DecodedFrame>& frame, BlackmagicRawResourceFormat format, BlackmagicRawResolutionScale scale, bool demanded) {
+	/* a frame another source already has in flight costs nothing but the copy. the job lock is held until the
+	   new job is submitted, so nobody joins a job that fails to start */
+	std::lock_guard<std::mutex> guard(jobLock);
+
+	auto range = jobs.equal_range(frame->frameIndex);
+	for (auto it = range.first; it != range.second; ++it) {
+		DecodeJob* job = it->second;
+		//a job without metadata is not enough once any attached source asked for it
+		if (formatBits(job->format) >= formatBits(format) && scaleDivisor(job->scale) <= scaleDivisor(scale) && (job->metadata || !metadata)) {
+			//queued read ahead of another source that we need now goes to the sdk with us
+			if (demanded && !job->started) {
+				HRESULT result = startJob(job);
+				if (result != S_OK)
+					return result;
+				queued.erase(std::find(queued.begin(), queued.end(), job));
+			}
+			job->demanded = job->demanded || demanded;
+			job->targets.push_back({ output, frame });
+			return S_OK;
+		}
+	}
+
+	std::unique_ptr<DecodeJob> job(new DecodeJob());
+	job->decoder = this;
+	job->frameIndex = frame->frameIndex;
+	job->format = resourceFormat;
+	job->scale = resolutionScale;
+	job->metadata = metadata;
+	job->demanded = demanded;
+	job->targets.push_back({ output, frame });
+
+	//read ahead waits behind what the sdk has already, so a demanded frame never queues behind a long read ahead
+	//the frame index is read before release(), the order of the emplace arguments is unspecified
+	unsigned long long frameIndex = job->frameIndex;
+	if (!demanded && startedJobs >= s_maxStartedJobs) {
+		queued.push_back(job.get());
+		jobs.emplace(frameIndex, job.release());
+		return S_OK;
+	}
+
+	//on success the sdk callbacks own the job until jobDone
+	HRESULT result = startJob(job.get());
+	if (result != S_OK)
+		return result;
+	jobs.emplace(frameIndex, job.release());
+	return S_OK;
+}
+
+HRESULT BRawDecoder::demand(const std::shared_ptr<DecodedFrame>& frame) {
+	/* the frame was read ahead and is still queued, it starts now instead of after the read ahead before it.
+	   if it fails to start, the other sources of the job keep it queued */
+	std::lock_guard<std::mutex> guard(jobLock);
+
+	auto range = jobs.equal_range(frame->frameIndex);
+	for (auto it = range.first; it != range.second; ++it) {
+		DecodeJob* job = it->second;
+		auto target = std::find_if(job->targets.begin(), job->targets.end(), [&frame](const DecodeJob::Target& t) {
+			return t.frame == frame;
+		});
+		if (target == job->targets.end())
+			continue;
+		if (job->started)
+			return S_OK;
+
+		HRESULT result = startJob(job);
+		if (result == S_OK) {
+			job->demanded = true;
+			queued.erase(std::find(queued.begin(), queued.end(), job));
+			return S_OK;
+		}
+		job->targets.erase(target);
+		if (job->targets.empty())
+			dropQueued(job);
+		return result;
+	}
+	return S_OK;
+}
+
+std::vector<std::shared_ptr<DecodedFrame>> BRawDecoder::cancelReadAhead(BRAWSDKProcessor* output, unsigned long long keepFirst, unsigned long long keepLast) {
+	/* after a jump the queued read ahead of the old position is stale, jobs the sdk has already are left to finish */
+	std::lock_guard<std::mutex> guard(jobLock);
+
+	std::vector<std::shared_ptr<DecodedFrame>> cancelled;
+	std::vector<DecodeJob*> orphans;
+	for (DecodeJob* job : queued) {
+		if (job->frameIndex >= keepFirst && job->frameIndex <= keepLast)
+			continue;
+		std::vector<DecodeJob::Target>& targets = job->targets;
+		for (auto it = targets.begin(); it != targets.end();) {
+			if (it->output == output) {
+				cancelled.push_back(it->frame);
+				it = targets.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+		if (targets.empty())
+			orphans.push_back(job);
+	}
+	for (DecodeJob* job : orphans)
+		dropQueued(job);
+	return cancelled;
+}
+
+void BRawDecoder::onRequest(unsigned long long clipFrame, bool sequential) {
+	if (!fileReadAhead)
+		return;
+	size_t segment = segmentForFrame(clipFrame);
+	fileReadAhead->onRequest(segment, clipFrame - segments[segment].firstFrame, sequential);
+}
+
+void BRAWSDKProcessor::submitFrame(std::shared_ptr<DecodedFrame>& frame) {
+	/* frame is returned in callback processcomplete, called with fetchLock held */
+	frame->submitted = std::chrono::steady_clock::now();
+	frames[frame->frameIndex] = frame;
+
+	//read ahead may wait in the queue of the decoder, pinned frames were asked for like a request
+	HRESULT result = decoder->submit(this, frame, resourceFormat, resolutionScale, !frame->readAhead || frame->pinned);
+	if (result != S_OK) {
+		frame->result = result;
+		frame->done = true;
+	}
+}
+
+void BRAWSDKProcessor::evictFrames(unsigned long long clipFrame) {
+	/* keeps frames that are read ahead of frameNum and the most recently used delivered ones,
+	   everything else that is done goes away. frames still in flight stay until they complete */
+	int depth = governor->depth();
+	size_t keepDelivered = governor->cacheFrames();
+
+	std::vector<std::shared_ptr<DecodedFrame>> delivered;
+	for (auto it = frames.begin(); it != frames.end();) {
+		DecodedFrame& f = *it->second;
+		bool ahead = f.frameIndex > clipFrame && f.frameIndex <= clipFrame + std::max(depth, 1) * rangeStep;
+		if (!f.done || ((ahead || f.pinned) && f.deliveries == 0)) {
+			++it;
+			continue;
+		}
+		if (f.deliveries > 0 && !FAILED(f.result)) {
+			delivered.push_back(it->second);
+			++it;
+			continue;
+		}
+		it = frames.erase(it);
+	}
+
+	if (delivered.size() <= keepDelivered)
+		return;
+
+	std::sort(delivered.begin(), delivered.end(), [](const std::shared_ptr<DecodedFrame>& a, const std::shared_ptr<DecodedFrame>& b) {
+		return a->lastUsed > b->lastUsed;
+	});
+	for (size_t i = keepDelivered; i < delivered.size(); i++)
+		frames.erase(delivered[i]->frameIndex);
+}
+
+std::shared_ptr<DecodedFrame> BRAWSDKProcessor::fetchFrame(int frameNum, const OutputAllocator& allocate) {
+	/* returns frameNum once it is decoded, submits read ahead jobs as decided by the governor */
+	char buff[128] = {};
+
+	//a file that is still opening in the background is only waited for when one of its frames is requested
+	decoder->waitForSegment(rangeFirst + frameNum * rangeStep);
+
+	std::unique_lock<std::mutex> guard(fetchLock);
+
+	//frontends that request from several threads at once see the frames close to the last one out of order
+	int window = std::max(options.parallelRequests, 1);
+	bool sequential = lastRequested < 0 || frameNum == lastRequested + 1 || (frameNum == lastRequested && lastSequential)
+		|| (window > 1 && frameNum > lastRequested - window && frameNum <= lastRequested + window);
+	lastRequested = window > 1 && sequential ? std::max<long long>(lastRequested, frameNum) : frameNum;
+	lastSequential = sequential;
+	governor->onRequest(sequential);
+
+	//frames are stored with their clip frame index, the range is applied here only
+	unsigned long long clipFrame = rangeFirst + frameNum * rangeStep;
+
+	//sampled frames are too far apart for reading the file ahead
+	decoder->onRequest(clipFrame, sequential && rangeStep == 1);
+
+	//read ahead of the old position that did not start yet would only delay this frame
+	if (!sequential) {
+		unsigned long long keepLast = clipFrame + std::max(governor->depth(), 0) * rangeStep;
+		for (std::shared_ptr<DecodedFrame>& stale : decoder->cancelReadAhead(this, clipFrame, keepLast)) {
+			auto it = frames.find(stale->frameIndex);
+			if (it != frames.end() && it->second == stale)
+				frames.erase(it);
+			stale->result = E_ABORT;
+			stale->done = true;
+		}
+	}
+
+	std::shared_ptr<DecodedFrame> frame;
+	auto found = frames.find(clipFrame);
+	bool hit = found != frames.end() && !FAILED(found->second->result);
+	if (hit) {
+		frame = found->second;
+		//read ahead that is still queued is needed now
+		if (!frame->done) {
+			HRESULT result = decoder->demand(frame);
+			if (result != S_OK) {
+				frame->result = result;
+				frame->done = true;
+			}
+		}
+	}
+	else {
+		frame = std::make_shared<DecodedFrame>();
+		frame->frameIndex = clipFrame;
+		frame->output = allocate();
+		submitFrame(frame);
+	}
+	governor->onHit(hit, hit && frame->deliveries > 0);
+
+	int depth = governor->depth();
+	for (int i = 1; i <= depth && (unsigned long long)frameNum + i < rangeFrames; i++) {
+		unsigned long long next = clipFrame + i * rangeStep;
+		if (frames.count(next))
+			continue;
+		//the next file is still opening in the background, it is read ahead once it is open
+		if (!decoder->segmentOpened(next))
+			break;
+		auto ahead = std::make_shared<DecodedFrame>();
+		ahead->frameIndex = next;
+		ahead->readAhead = true;
+		ahead->output = allocate();
+		submitFrame(ahead);
+	}
+
+	frameDone.wait(guard, [&frame] { return frame->done; });
+
+	frame->deliveries++;
+	frame->lastUsed = ++useCounter;
+	//every frame counts once for the clip summary, however often it is decoded or delivered
+	if (options.qc && frame->deliveries == 1 && !FAILED(frame->result) && qcCounted.insert(clipFrame).second)
+		clipQc.merge(frame->qc);
+	evictFrames(clipFrame);
+
+	if (FAILED(frame->result)) {
+		//values the camera does not support only show up in the frames, there is nothing to check at open
+		if (frame->settingsRejected)
+			sprintf(buff, "iso, kelvin, tint or exposure is not supported at frame %d, HRESULT 0x%08lx", frameNum, (unsigned long)frame->result);
+		else
+			sprintf(buff, "Failed to decode frame %d, HRESULT 0x%08lx", frameNum, (unsigned long)frame->result);
+		throw std::runtime_error(buff);
+	}
+
+	return frame;
+}
+
+void BRAWSDKProcessor::warmUp(const OutputAllocator& allocate, unsigned long long count) {
+	/* starts decoding the first frame of the range right away, so the first GetFrame finds it done or in flight
+	   instead of paying for a cold decoder. it is a read ahead frame, eviction drops it if nobody asks for it.
+	   with count > 1 (sampled thumbnails) all frames go to the sdk at once and decode in parallel, they stay
+	   until delivered. pinned frames are never evicted, so they are capped by the memory budget, what does not
+	   fit is read ahead as usual later */
+	std::lock_guard<std::mutex> guard(fetchLock);
+
+	count = std::min<unsigned long long>(count, rangeFrames);
+	if (count > 1)
+		count = std::min<unsigned long long>(count, std::max<size_t>(governor->budgetFrames(), 1));
+
+	for (unsigned long long i = 0; i < count; i++) {
+		unsigned long long clipFrame = rangeFirst + i * rangeStep;
+		if (frames.count(clipFrame))
+			continue;
+		if (!decoder->segmentOpened(clipFrame))
+			break;
+		auto frame = std::make_shared<DecodedFrame>();
+		frame->frameIndex = clipFrame;
+		frame->readAhead = true;
+		frame->pinned = count > 1;
+		frame->output = allocate();
+		submitFrame(frame);
+	}
+}
+
+void BRawDecoder::preparePipeline() {
+	/* the sdk builds its decode pipeline asynchronously and reports in PreparePipelineComplete,
+	   meanwhile the clips are opened */
+	{
+		std::lock_guard<std::mutex> guard(pipelineLock);
+		pipelinePending = true;
+	}
+	HRESULT result = codec->PreparePipeline(blackmagicRawPipelineCPU, nullptr, nullptr, this);
+	if (result != S_OK)
+		pipelinePrepared(result); //not fatal, the first job prepares it then
+}
+
+void BRawDecoder::pipelinePrepared(HRESULT result) {
+	{
+		std::lock_guard<std::mutex> guard(pipelineLock);
+		pipelineResult = result;
+		pipelinePending = false;
+	}
+	pipelineDone.notify_all();
+}
+
+static IBlackmagicRawFactory* acquireFactory() {
+	/* the sdk dlls are loaded once per process, every decoder holds a reference on the shared factory */
+	static std::mutex factoryLock;
+	static IBlackmagicRawFactory* sharedFactory = nullptr;
+
+	std::lock_guard<std::mutex> guard(factoryLock);
+	if (sharedFactory == nullptr) {
+		/* path of the plugin itself (BRawsource.dll or the vapoursynth .so) as base for locating the sdk libraries */
+		std::string pathname = moduleDirectory();
+		pathname = pathname.append("brawsource_dlls");
+
+		SdkStringArg libraryPath(pathname);
+		sharedFactory = CreateBlackmagicRawFactoryInstanceFromPath(libraryPath);
+		if (sharedFactory == nullptr)
+			return nullptr;
+	}
+	sharedFactory->AddRef();
+	return sharedFactory;
+}
+
+void BRawDecoder::openClip(ClipSegment& segment) {
+	/* opens one file and reads what VideoInfo needs, the frame count is only in the header of the clip */
+	char buff[MAX_PATH + 128] = {};
+
+	SdkStringArg fileName(segment.fileName);
+	HRESULT result = codec->OpenClip(fileName, segment.clip.put());
+
+	if (result != S_OK)
+	{
+		sprintf(buff, "Failed to open IBlackmagicRawClip %s, is it in braw format?", segment.fileName.c_str());
+		throw std::runtime_error(buff);
+	}
+
+	result = segment.clip->GetFrameCount(&segment.frameCount);
+}
+
+void BRawDecoder::openSegment(ClipSegment& segment) {
+	/* the rest of an opened clip, needed once its frames or audio are read */
+	char buff[MAX_PATH + 128] = {};
+
+	//clips recorded to several cards at once are one clip for the sdk, but all card files must be there
+	uint32_t cardFiles = 0;
+	if (segment.clip->GetMulticardFileCount(&cardFiles) == S_OK) {
+		for (uint32_t i = 0; i < cardFiles; i++) {
+			bool present = true;
+			if (segment.clip->IsMulticardFilePresent(i, &present) == S_OK && !present) {
+				sprintf(buff, "%s was recorded to %u cards, the file of card %u is missing", segment.fileName.c_str(), cardFiles, i + 1);
+				throw std::runtime_error(buff);
+			}
+		}
+	}
+
+	HRESULT result = segment.clip->QueryInterface(IID_IBlackmagicRawClipAudio, segment.audio.putVoid());
+	
+	if (result != S_OK)
+	{
+		sprintf(buff, "Could not init Audioreader using BMD SDK!");
+		throw std::runtime_error(buff);
+	}
+
+	result = segment.audio->GetAudioSampleCount(&segment.audioSamples);
+
+	buildClipAttributes(segment);
+}
+
+static std::vector<std::exception_ptr> runOnOpenThreads(size_t count, const std::function<void(size_t)>& open) {
+	/* opening a clip is mostly waiting for the header reads of the file, so the files of a playlist or
+	   card span are opened on a few threads at once */
+	unsigned workers = std::min<unsigned>((unsigned)count, std::max(std::thread::hardware_concurrency(), 1u));
+	workers = std::min(workers, s_maxOpenThreads);
+
+	std::vector<std::exception_ptr> errors(count);
+	std::atomic<size_t> next(0);
+	auto run = [count, &open, &errors, &next]() {
+		for (size_t i = next++; i < count; i = next++) {
+			try {
+				open(i);
+			}
+			catch (...) {
+				errors[i] = std::current_exception();
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < workers; i++)
+		pool.emplace_back(run);
+	run();
+	for (std::thread& t : pool)
+		t.join();
+	return errors;
+}
+
+void BRawDecoder::openSegments() {
+	/* the constructor waits for the headers of all files, VideoInfo needs their frame counts (and the audio
+	   length, which follows from them), and for the first file. the rest of the other files is opened in the
+	   background, their frames and audio wait for it. the first error in file order is reported */
+	for (std::exception_ptr& error : runOnOpenThreads(segments.size(), [this](size_t i) { openClip(segments[i]); })) {
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	openSegment(segments[0]);
+	std::promise<void> first;
+	first.set_value();
+	segments[0].opened = first.get_future().share();
+
+	std::vector<std::promise<void>> opening(segments.size() - 1);
+	for (size_t i = 1; i < segments.size(); i++)
+		segments[i].opened = opening[i - 1].get_future().share();
+	if (opening.empty())
+		return;
+
+	opener = std::thread([this, opening = std::move(opening)]() mutable {
+		runOnOpenThreads(opening.size(), [this, &opening](size_t i) {
+			ClipSegment& segment = segments[i + 1];
+			try {
+				openSegment(segment);
+			}
+			catch (...) {
+				segment.openError = std::current_exception();
+			}
+			opening[i].set_value();
+		});
+	});
+}
+
+void BRawDecoder::waitForOpen(const ClipSegment& segment) {
+	segment.opened.wait();
+	if (segment.openError)
+		std::rethrow_exception(segment.openError);
+}
+
+bool BRawDecoder::segmentOpened(unsigned long long frame) {
+	const ClipSegment& segment = segments[segmentForFrame(frame)];
+	return segment.opened.wait_for(std::chrono::seconds(0)) == std::future_status::ready && !segment.openError;
+}
+
+void BRawDecoder::waitForSegment(unsigned long long frame) {
+	waitForOpen(segments[segmentForFrame(frame)]);
+}
+
+static std::string decoderKey(const std::vector<std::string>& fileNames, const ProcessorOptions& options) {
+	/* everything that changes what the sdk delivers, sources that only differ in bits, crop, resize, scale or LUT
+	   get the same key. attach decodes at the largest scale of all sources, geometryFor resamples from it */
+	char buff[256] = {};
+	std::string key;
+	for (const std::string& fileName : fileNames)
+		key += fileName + "|";
+	snprintf(buff, sizeof(buff), "%d|%d|%d%d%d%d|%u|%u|%d|%g|", options.threads, options.numaNode,
+		options.setIso, options.setKelvin, options.setTint, options.setExposure,
+		options.iso, options.kelvin, options.tint, options.exposure);
+	return key + buff + options.affinity + "|" + options.gamma + "|" + options.gamut;
+}
+
+std::shared_ptr<BRawDecoder> BRawDecoder::acquire(const std::vector<std::string>& fileNames, const ProcessorOptions& options) {
+	/* the registry only holds weak references, the decoder goes away with the last source using it.
+	   opening runs outside of the registry lock, so separate sources (multicam) open at the same time,
+	   sources with the same key wait for the one that is opening it */
+	struct Entry {
+		std::weak_ptr<BRawDecoder> decoder;
+		std::shared_future<std::shared_ptr<BRawDecoder>> opening; //valid while the first source opens it
+	};
+	static std::mutex registryLock;
+	static std::map<std::string, Entry> registry;
+
+	std::string key = decoderKey(fileNames, options);
+	std::promise<std::shared_ptr<BRawDecoder>> opened;
+	for (;;) {
+		std::shared_future<std::shared_ptr<BRawDecoder>> opening;
+		{
+			std::lock_guard<std::mutex> guard(registryLock);
+			for (auto it = registry.begin(); it != registry.end();)
+				it = !it->second.opening.valid() && it->second.decoder.expired() ? registry.erase(it) : std::next(it);
+
+			//the last source of a decoder may be going away right now, then it is opened again
+			auto found = registry.find(key);
+			if (found == registry.end()) {
+				registry[key].opening = opened.get_future().share();
+				break;
+			}
+			std::shared_ptr<BRawDecoder> existing = found->second.decoder.lock();
+			if (existing)
+				return existing;
+			if (!found->second.opening.valid()) {
+				registry.erase(found);
+				continue;
+			}
+			opening = found->second.opening;
+		}
+		//rethrows the error of the source that opened it
+		std::shared_ptr<BRawDecoder> decoder = opening.get();
+		if (decoder)
+			return decoder;
+	}
+
+	std::shared_ptr<BRawDecoder> decoder;
+	try {
+		decoder = std::make_shared<BRawDecoder>();
+		decoder->open(fileNames, options);
+	}
+	catch (...) {
+		{
+			std::lock_guard<std::mutex> guard(registryLock);
+			registry.erase(key);
+		}
+		opened.set_exception(std::current_exception());
+		throw;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(registryLock);
+		Entry& entry = registry[key];
+		entry.decoder = decoder;
+		entry.opening = std::shared_future<std::shared_ptr<BRawDecoder>>();
+	}
+	opened.set_value(decoder);
+	return decoder;
+}
+
+void BRawDecoder::open(const std::vector<std::string>& fileNames, const ProcessorOptions& options) {
+
+	HRESULT result = S_OK;
+	char buff[MAX_PATH + 128] = {};
+
+	//in Avisynth environment, COM is already initialized
+	/*result = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	if (result != S_OK)
+	{
+		sprintf(buff, "COM init failed, HRESULT %d",result);
+		throw std::runtime_error(buff);
+	}*/
+
+	this->options = options;
+
+	factory = SdkRef<IBlackmagicRawFactory>(acquireFactory());
+	if (!factory)
+	{
+		sprintf(buff, "Failed to create IBlackmagicRawFactory, did you place brawsource_dlls folder next to this dll`?");
+		throw std::runtime_error(buff);
+	}
+
+	result = factory->CreateCodec(codec.put());
+	if (result != S_OK)
+	{
+		sprintf(buff, "Failed to create IBlackmagicRaw, this is unexpected, i don't know what could cause it!");
+		throw std::runtime_error(buff);
+	}
+
+	//thread placement, explicit cpu list wins over numa node
+	if (!options.affinity.empty()) {
+		if (!parseAffinity(options.affinity.c_str(), workerAffinity)) {
+			sprintf(buff, "affinity must be a cpu list like 0-7,16-23 within one processor group");
+			throw std::runtime_error(buff);
+		}
+		pinThreads = true;
+	}
+	else if (options.numaNode >= 0) {
+		if (!numaNodeAffinity(options.numaNode, workerAffinity)) {
+			sprintf(buff, "numa_node %d does not exist on this machine", options.numaNode);
+			throw std::runtime_error(buff);
+		}
+		pinThreads = true;
+	}
+
+	//decoder worker count, must be set before the first job is submitted
+	uint32_t threads = options.threads > 0 ? options.threads : (pinThreads ? affinityCpuCount(workerAffinity) : 0);
+	if (threads > 0) {
+		result = codec->QueryInterface(IID_IBlackmagicRawConfiguration, config.putVoid());
+		if (result != S_OK)
+		{
+			sprintf(buff, "Failed to get IBlackmagicRawConfiguration!");
+			throw std::runtime_error(buff);
+		}
+		uint32_t maxThreads = 0;
+		if (config->GetMaxCPUThreadCount(&maxThreads) == S_OK && maxThreads > 0)
+			threads = std::min(threads, maxThreads);
+		result = config->SetCPUThreads(threads);
+		if (result != S_OK)
+		{
+			sprintf(buff, "Failed to set %u sdk cpu threads!", threads);
+			throw std::runtime_error(buff);
+		}
+	}
+
+	//one callback for all jobs of this codec, the DecodeJob travels in the job userdata
+	callback = SdkRef<CameraCodecCallback>(new CameraCodecCallback());
+	result = codec->SetCallback(callback.get());
+	if (result != S_OK)
+	{
+		sprintf(buff, "Failed to set IBlackmagicRawCallback!");
+		throw std::runtime_error(buff);
+	}
+
+	//warms up in the background while the files are opened
+	preparePipeline();
+
+	//all files go through one codec, so read ahead simply continues into the next file
+	segments.resize(fileNames.size());
+	for (size_t i = 0; i < fileNames.size(); i++)
+		segments[i].fileName = fileNames[i];
+	openSegments();
+
+	//analyze clip props, the first file decides the format of the whole playlist
+	IBlackmagicRawClip* clip = segments[0].clip.get();
+	result = clip->GetWidth(&this->width);
+	result = clip->GetHeight(&this->height);
+	result = clip->GetFrameRate(&this->framerate);
+	
+	//hackily try to get fraction from framerate float, bmd skd does not seem to provide num and den
+	floatToFraction(this->framerate, this->framerate_num, this->framerate_den);
+
+	IBlackmagicRawClipAudio* audio = segments[0].audio.get();
+	result = audio->GetAudioBitDepth(&this->audioBitDepth);
+	result = audio->GetAudioChannelCount(&this->channelCount);
+	result = audio->GetAudioSampleRate(&this->sampleRate);
+
+	double samplesPerFrame = (double)sampleRate * framerate_den / framerate_num;
+	this->frameCount = 0;
+	this->audioSamples = 0;
+	for (ClipSegment& segment : segments) {
+		uint32_t w = 0, h = 0;
+		float rate = 0;
+		segment.clip->GetWidth(&w);
+		segment.clip->GetHeight(&h);
+		segment.clip->GetFrameRate(&rate);
+		if (w != width || h != height || rate != framerate)
+		{
+			sprintf(buff, "%s has a different resolution or frame rate than the first file", segment.fileName.c_str());
+			throw std::runtime_error(buff);
+		}
+
+		segment.firstFrame = this->frameCount;
+		segment.firstAudioSample = (int64_t)this->audioSamples;
+		segment.audioSpan = segments.size() == 1 ? (int64_t)segment.audioSamples : (int64_t)std::llround(segment.frameCount * samplesPerFrame);
+		this->frameCount += segment.frameCount;
+		this->audioSamples += segment.audioSpan;
+	}
+
+	if (options.compressedCacheMB > 0)
+		compressedCache = std::make_unique<CompressedCache>((uint64_t)options.compressedCacheMB << 20);
+
+	if (options.readAheadMB > 0) {
+		std::vector<FileReadAhead::File> files(segments.size());
+		for (size_t i = 0; i < segments.size(); i++) {
+			files[i].name = segments[i].fileName;
+			files[i].frameCount = segments[i].frameCount;
+			IBlackmagicRawClip* clip = segments[i].clip.get();
+			uint64_t frameCount = segments[i].frameCount;
+			files[i].frameSizes = [clip, frameCount]() {
+				std::vector<uint32_t> sizes;
+				SdkRef<IBlackmagicRawClipEx> clipEx;
+				if (clip->QueryInterface(IID_IBlackmagicRawClipEx, clipEx.putVoid()) != S_OK)
+					return sizes;
+				sizes.resize((size_t)frameCount);
+				for (uint64_t i = 0; i < frameCount; i++) {
+					if (clipEx->GetBitStreamSizeBytes(i, &sizes[(size_t)i]) != S_OK) {
+						sizes.clear();
+						break;
+					}
+				}
+				return sizes;
+			};
+		}
+		fileReadAhead = std::make_unique<FileReadAhead>(files, (size_t)options.readAheadMB << 20);
+	}
+}
+
+HRESULT BRAWSDKProcessor::openFile(const std::vector<std::string>& fileNames, int bitmode, const ProcessorOptions& options) {
+
+	HRESULT result = S_OK;
+	char buff[MAX_PATH + 128] = {};
+
+	this->options = options;
+
+	//decide bitmode
+	switch (bitmode){
+		case 8: 
+			resourceFormat = blackmagicRawResourceFormatBGRAU8;
+			break;		
+		case 16:
+			resourceFormat = blackmagicRawResourceFormatRGBU16Planar;
+			break;
+		case 32: 
+			resourceFormat = blackmagicRawResourceFormatRGBF32Planar;
+			break;
+		
+		default:{
+			sprintf(buff, "only 8 or 32 bit output supported!");
+			throw std::runtime_error(buff);
+		}
+	}
+
+	if (fileNames.empty())
+	{
+		sprintf(buff, "No source file found");
+		throw std::runtime_error(buff);
+	}
+
+	//sources on the same files with the same raw settings read and decode every frame once
+	decoder = BRawDecoder::acquire(fileNames, options);
+
+	this->frameCount = decoder->frameCount;
+	this->width = decoder->width;
+	this->height = decoder->height;
+	this->framerate = decoder->framerate;
+	this->framerate_num = decoder->framerate_num;
+	this->framerate_den = decoder->framerate_den;
+	this->audioSamples = decoder->audioSamples;
+	this->audioBitDepth = decoder->audioBitDepth;
+	this->channelCount = decoder->channelCount;
+	this->sampleRate = decoder->sampleRate;
+
+	chooseGeometry();
+
+	governor = std::make_unique<PrefetchGovernor>(frameSizeBytes(), s_maxReadAhead);
+
+	loadLut();
+
+	decoder->attach(resourceFormat, resolutionScale, options.metadata);
+
+	//whole clip until the frontend narrows it down
+	rangeFirst = 0;
+	rangeFrames = frameCount;
+	rangeAudioFirst = 0;
+	rangeAudioSamples = audioSamples;
 	//BlackmagicRawAudioFormat can only be littleendian
 
 	return result;
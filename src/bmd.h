@@ -1,8 +1,13 @@
 
-
 #ifndef BMDPROCESSORHEADER_H
 #define BMDPROCESSORHEADER_H
 
+#include "platform.h"
+
+#ifdef _WIN32
+
+#include <comutil.h>
+
 #include "C:\Program Files (x86)\Blackmagic Design\Blackmagic RAW\Blackmagic RAW SDK\Win\Include\BlackmagicRawAPIDispatch.h"
 //built by compiling BlackmagicRawAPI.idl File (as BlackmagicRawAPI.h)
 #include "generated/BlackmagicRawAPI_i.c"
@@ -10,15 +15,474 @@
 
 /* Note that we also add the BlackmagicRawAPIDispatch.cpp file in our project from the same folder */
 
+//strings the sdk hands out are BSTR owned by the caller
+typedef BSTR SdkString;
+
+static inline std::string fromSdkString(SdkString s) {
+	return s != nullptr ? std::string((const char*)_bstr_t(s, false)) : std::string();
+}
+
+class SdkStringArg {
+	/* string argument for an sdk call, freed after the call */
+public:
+	explicit SdkStringArg(const std::string& s) : value(_bstr_t(s.c_str()).copy()) {}
+	~SdkStringArg() { SysFreeString(value); }
+	operator BSTR() const { return value; }
+private:
+	BSTR value;
+};
+
+typedef VARTYPE VariantType;
+
+static inline bool variantString(const VARIANT& data, std::string& text) {
+	if (data.vt != VT_BSTR)
+		return false;
+	text = data.bstrVal != nullptr ? (const char*)_bstr_t(data.bstrVal) : "";
+	return true;
+}
+
+static inline bool variantIsArray(const VARIANT& data) {
+	return (data.vt & VT_ARRAY) && data.parray != nullptr;
+}
+
+class VariantArg {
+	/* attribute value handed to the sdk, strings are copied into the variant and freed with it */
+public:
+	VariantArg() { VariantInit(&value); }
+	~VariantArg() { VariantClear(&value); }
+	void setU32(uint32_t v) { VariantClear(&value); value.vt = VT_UI4; value.ulVal = v; }
+	void setS16(int16_t v) { VariantClear(&value); value.vt = VT_I2; value.iVal = v; }
+	void setFloat(float v) { VariantClear(&value); value.vt = VT_R4; value.fltVal = v; }
+	void setString(const std::string& v) { VariantClear(&value); value.vt = VT_BSTR; value.bstrVal = _bstr_t(v.c_str()).copy(); }
+	VARIANT* get() { return &value; }
+private:
+	VARIANT value;
+};
+
+#else
+
+//Include folder of the linux sdk is in the include path, BlackmagicRawAPIDispatch.cpp is built with the plugin
+#include "BlackmagicRawAPI.h"
+
+#ifndef STDMETHODCALLTYPE
+#define STDMETHODCALLTYPE
+#endif
+
+typedef Variant VARIANT;
+
+//the linux sdk uses utf-8 strings that stay owned by the sdk
+typedef const char* SdkString;
+
+static inline std::string fromSdkString(SdkString s) {
+	return s != nullptr ? std::string(s) : std::string();
+}
+
+class SdkStringArg {
+public:
+	explicit SdkStringArg(const std::string& s) : value(s) {}
+	operator const char*() const { return value.c_str(); }
+private:
+	std::string value;
+};
+
+typedef BlackmagicRawVariantType VariantType;
+
+static inline bool variantString(const VARIANT& data, std::string& text) {
+	if (data.vt != blackmagicRawVariantTypeString)
+		return false;
+	text = data.bstrVal != nullptr ? data.bstrVal : "";
+	return true;
+}
+
+static inline bool variantIsArray(const VARIANT& data) {
+	return data.vt == blackmagicRawVariantTypeSafeArray && data.parray != nullptr;
+}
+
+class VariantArg {
+	/* the variant only points at the string, it stays alive as long as the argument */
+public:
+	VariantArg() { VariantInit(&value); }
+	void setU32(uint32_t v) { value.vt = blackmagicRawVariantTypeU32; value.uintVal = v; }
+	void setS16(int16_t v) { value.vt = blackmagicRawVariantTypeS16; value.iVal = v; }
+	void setFloat(float v) { value.vt = blackmagicRawVariantTypeFloat32; value.fltVal = v; }
+	void setString(const std::string& v) { text = v; value.vt = blackmagicRawVariantTypeString; value.bstrVal = text.c_str(); }
+	VARIANT* get() { return &value; }
+private:
+	VARIANT value;
+	std::string text;
+};
+
+#endif
+
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
+
+#include "lut.h"
+#include "prefetch.h"
+#include "qc.h"
+#include "readahead.h"
+#include "resize.h"
+
+class CameraCodecCallback;
+class BRawDecoder;
+class BRAWSDKProcessor;
+
+template<typename T>
+class SdkRef {
+	/* owns one reference on an sdk object and releases it when it goes away. put() is for the out parameters
+	   of the sdk, which hand over a reference, share() takes an extra one on a pointer that is only borrowed.
+	   detach() gives the reference away, e.g. a submitted job is released in its completion callback */
+public:
+	SdkRef() = default;
+	explicit SdkRef(T* adopted) : ptr(adopted) {}
+	SdkRef(const SdkRef& other) : ptr(other.ptr) {
+		if (ptr != nullptr)
+			ptr->AddRef();
+	}
+	SdkRef(SdkRef&& other) : ptr(other.ptr) {
+		other.ptr = nullptr;
+	}
+	SdkRef& operator=(SdkRef other) {
+		std::swap(ptr, other.ptr);
+		return *this;
+	}
+	~SdkRef() {
+		reset();
+	}
+
+	static SdkRef share(T* borrowed) {
+		if (borrowed != nullptr)
+			borrowed->AddRef();
+		return SdkRef(borrowed);
+	}
+
+	void reset() {
+		T* old = ptr;
+		ptr = nullptr;
+		if (old != nullptr)
+			old->Release();
+	}
+	T** put() {
+		reset();
+		return &ptr;
+	}
+	void** putVoid() {
+		return (void**)put();
+	}
+	T* detach() {
+		T* old = ptr;
+		ptr = nullptr;
+		return old;
+	}
+
+	T* get() const { return ptr; }
+	T* operator->() const { return ptr; }
+	explicit operator bool() const { return ptr != nullptr; }
+
+private:
+	T* ptr = nullptr;
+};
+
+class OutputFrame {
+	/* destination of one decoded frame, allocated by the frontend (avisynth frame) so the copy out of
+	   ProcessComplete lands directly in the buffer that is handed out later */
+public:
+	virtual ~OutputFrame() = default;
+	uint8_t* planes[4] = {};
+	int pitches[4] = {};           //negative for bottom up frames, planes[] then points to the top row
+	int numPlanes = 0;
+};
+
+typedef std::function<std::shared_ptr<OutputFrame>()> OutputAllocator;
+
+struct MetadataValue {
+	/* one camera metadata entry, arrays (e.g. gyro samples) keep all elements */
+	enum Type { Int, Float, String };
+	std::string key;
+	Type type = Int;
+	std::vector<int64_t> ints;
+	std::vector<double> floats;
+	std::string text;
+};
+
+typedef std::vector<MetadataValue> Metadata;
+
+struct DecodedFrame {
+	/* one frame in the fetch layer, either in flight or done and cached */
+	unsigned long long frameIndex = 0;
+	std::shared_ptr<OutputFrame> output;
+	bool done = false;
+	HRESULT result = S_OK;
+	int deliveries = 0;            //how often fetchFrame returned this frame
+	bool readAhead = false;        //submitted by the governor before anybody asked for it
+	bool pinned = false;           //submitted up front, not evicted before it was delivered once
+	unsigned long long lastUsed = 0;
+	std::chrono::steady_clock::time_point submitted;
+	double readMs = 0;             //submit -> ReadComplete, mostly waiting for the file on network storage
+	bool compressedHit = false;    //read from the compressed cache, no I/O
+	bool sharedDecode = false;     //the processed image was copied to other sources as well
+	bool settingsRejected = false; //failed because iso, kelvin, tint or exposure is not supported
+	QcStats qc;                    //qc=true only, of the output picture
+
+	//camera metadata, read from the frame of the completed read job, no extra I/O
+	std::string timecode;
+	Metadata frameMetadata;
+	std::shared_ptr<const Metadata> clipMetadata;
+};
+
+struct ProcessorOptions {
+	/* settings given by the frontend. sources that agree on thread placement, raw processing and scale share
+	   one decoder, the rest is per source or taken from the first one that opened the files */
+	int threads = 0;               //sdk cpu decode threads, 0 = sdk default (or cpu count of the numa node)
+	int numaNode = -1;             //pin sdk worker threads to this node, -1 = no pinning
+	std::string affinity;          //explicit cpu list like "0-7,16-23", wins over numaNode
+
+	//raw processing, only what is set here overrides the settings the camera recorded
+	bool setIso = false;
+	bool setKelvin = false;
+	bool setTint = false;
+	bool setExposure = false;
+	uint32_t iso = 0;
+	uint32_t kelvin = 0;
+	int tint = 0;
+	float exposure = 0;
+	std::string gamma;
+	std::string gamut;
+
+	std::string lut;               //"embedded" or path of a .cube file, applied in the copy stage
+
+	bool metadata = true;          //read per frame and clip metadata for the frontend
+	bool qc = false;               //gather QcStats in the copy stage
+
+	int readAheadMB = 0;           //file read ahead window ahead of the sdk read jobs, 0 = off
+	int compressedCacheMB = 0;     //budget for read but not decoded frames, 0 = off
+
+	int scale = 1;                 //decode at 1/scale of the recorded size (2, 4, 8), the sdk picks the closest it has
+
+	//region of the recorded picture like Crop(), width/height <= 0 count from the right/bottom edge
+	bool crop = false;
+	int cropLeft = 0;
+	int cropTop = 0;
+	int cropWidth = 0;
+	int cropHeight = 0;
+	//output size, resampled in the copy stage, 0 for one side keeps the aspect ratio
+	int resizeWidth = 0;
+	int resizeHeight = 0;
+
+	int parallelRequests = 1;      //frames the frontend may request at once (vapoursynth threads), still counts as sequential
+};
+
+struct CompressedCacheStats {
+	uint64_t bytes = 0;
+	size_t frames = 0;
+	uint64_t hits = 0;
+};
+
+class CompressedCache {
+	/* second cache tier behind the decoded frames: frames as they come out of the read jobs, still compressed
+	   and 10-50x smaller than decoded. a re-request only pays the decode, no I/O. holds a reference on the sdk
+	   frame. the budget is process wide, the caches of all decoders share it (the largest one asked for) and
+	   the least recently used frames of any of them are released when it is exceeded */
+public:
+	explicit CompressedCache(uint64_t budgetBytes);
+	~CompressedCache();
+
+	void put(unsigned long long frameIndex, IBlackmagicRawFrame* frame);
+	SdkRef<IBlackmagicRawFrame> get(unsigned long long frameIndex); //empty if not cached
+	CompressedCacheStats stats();  //of this cache only
+
+private:
+	typedef std::list<std::pair<CompressedCache*, unsigned long long>> UseOrder;
+
+	struct Entry {
+		SdkRef<IBlackmagicRawFrame> frame;
+		uint64_t bytes = 0;
+		UseOrder::iterator use;
+	};
+
+	struct Pool {
+		std::mutex lock;
+		std::multiset<uint64_t> budgets; //of every cache alive
+		uint64_t bytes = 0;
+		UseOrder useOrder;               //most recently used first, over all caches
+	};
+	static Pool& pool();
+	static void evict(Pool& pool);    //pool lock held
+
+	uint64_t budget = 0;
+	//guarded by the pool lock
+	std::map<unsigned long long, Entry> entries;
+	CompressedCacheStats current;
+};
+
+struct ClipSegment {
+	/* one file of a playlist or card span, frame and audio positions are global over all segments */
+	std::string fileName;
+	SdkRef<IBlackmagicRawClip> clip;
+	SdkRef<IBlackmagicRawClipAudio> audio;
+	unsigned long long firstFrame = 0;
+	uint64_t frameCount = 0;
+	int64_t firstAudioSample = 0;
+	int64_t audioSpan = 0;         //samples this segment occupies, aligned to its video length like ++ does
+	uint64_t audioSamples = 0;     //samples really in the file
+
+	//built once and reused for every decode job of this file, nullptr = camera settings
+	SdkRef<IBlackmagicRawClipProcessingAttributes> clipAttributes;
+
+	std::shared_ptr<const Metadata> metadata; //static clip metadata, parsed once on the first read of the file
+
+	//everything but the clip and its frame count is opened in the background for all but the first file.
+	//ready once that is done, openError is then set if it failed
+	std::shared_future<void> opened;
+	std::exception_ptr openError;
+};
+
+struct DecodeJob {
+	/* one read and decode of a frame in the sdk, travels as userdata of the read job and the decode job.
+	   every source that asks for the frame while it is in flight joins it, ProcessComplete copies the one
+	   processed image to all of them */
+	struct Target {
+		BRAWSDKProcessor* output = nullptr;
+		std::shared_ptr<DecodedFrame> frame; //keeps a slot that gets evicted meanwhile valid
+	};
+
+	BRawDecoder* decoder = nullptr;
+	unsigned long long frameIndex = 0;
+	BlackmagicRawResourceFormat format = blackmagicRawResourceFormatBGRAU8;
+	BlackmagicRawResolutionScale scale = blackmagicRawResolutionScaleFull;
+	bool metadata = false;
+	std::vector<Target> targets;   //guarded by the jobLock of the decoder until ProcessComplete
+	bool demanded = false;         //a source waits for it (or it is pinned), never queued behind read ahead
+	bool started = false;          //handed to the sdk, before that it waits in the queue of the decoder
+	std::chrono::steady_clock::time_point submitted;
+	double readMs = 0;
+	bool compressedHit = false;
+	//the settings recorded for this frame with the overrides of the script, alive until ProcessComplete
+	SdkRef<IBlackmagicRawFrameProcessingAttributes> frameAttributes;
+	bool settingsRejected = false; //the sdk refused iso, kelvin, tint or exposure of the script for this frame
+
+	std::string timecode;
+	Metadata frameMetadata;
+	std::shared_ptr<const Metadata> clipMetadata;
+};
+
+class BRawDecoder {
+	/* the sdk codec and the opened files. sources on the same files with the same raw settings share one decoder,
+	   so an 8 bit proxy and a 16 bit master of one script read and decode every frame once. the decode runs in the
+	   widest format and at the largest scale any attached source asked for, each source converts in its copy */
+public:
+
+	//the shared decoder for these files and settings, opened on first use
+	static std::shared_ptr<BRawDecoder> acquire(const std::vector<std::string>& fileNames, const ProcessorOptions& options);
+	~BRawDecoder();
+
+	unsigned long long frameCount = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	float framerate = 0;
+	int framerate_num = 0;
+	int framerate_den = 0;
+
+	uint64_t audioSamples = 0;
+	uint32_t audioBitDepth = 0;
+	uint32_t channelCount = 0;
+	uint32_t sampleRate = 0;
+
+	std::vector<ClipSegment> segments;
+
+	//a source announces what it needs before it submits, detach waits for copies into it that are running
+	void attach(BlackmagicRawResourceFormat format, BlackmagicRawResolutionScale scale, bool metadata);
+	void detach(BRAWSDKProcessor* output);
+	//joins a job of the frame in flight that decodes enough for this source, otherwise submits one.
+	//demanded jobs go to the sdk at once, read ahead jobs wait while the sdk has s_maxStartedJobs
+	HRESULT submit(BRAWSDKProcessor* output, std::shared_ptr<DecodedFrame>& frame, BlackmagicRawResourceFormat format, BlackmagicRawResolutionScale scale, bool demanded);
+	//a source now waits for a frame it read ahead, a queued job of it is started right away
+	HRESULT demand(const std::shared_ptr<DecodedFrame>& frame);
+	//drops queued read ahead of this source outside of keepFirst..keepLast, returns the frames that will never complete
+	std::vector<std::shared_ptr<DecodedFrame>> cancelReadAhead(BRAWSDKProcessor* output, unsigned long long keepFirst, unsigned long long keepLast);
+	//the file of this frame finished opening, waitForSegment rethrows the error of the background open
+	bool segmentOpened(unsigned long long frame);
+	void waitForSegment(unsigned long long frame);
+	void onRequest(unsigned long long clipFrame, bool sequential);
+	void readAudio(uint8_t* dst, int64_t start, int64_t count);
+	long long frameForTimecode(const char* timecode);
+	FileReadStats fileReadStats();
+	CompressedCacheStats compressedCacheStats();
+
+	//called by CameraCodecCallback from sdk threads
+	void pinWorkerThread();
+	HRESULT decodeFrame(DecodeJob* job, IBlackmagicRawFrame* frame);
+	void jobDone(DecodeJob* job, HRESULT result, IBlackmagicRawProcessedImage* img);
+	void pipelinePrepared(HRESULT result);
+
+private:
+
+	void open(const std::vector<std::string>& fileNames, const ProcessorOptions& options);
+	void openClip(ClipSegment& segment);
+	void openSegment(ClipSegment& segment);
+	void openSegments();
+	void waitForOpen(const ClipSegment& segment);
+	void preparePipeline();
+	void buildClipAttributes(ClipSegment& segment);
+	HRESULT frameProcessingAttributes(IBlackmagicRawFrame* frame, SdkRef<IBlackmagicRawFrameProcessingAttributes>& attributes);
+	void readMetadata(DecodeJob& job, IBlackmagicRawFrame* frame);
+	size_t segmentForFrame(unsigned long long frame);
+	HRESULT startJob(DecodeJob* job);
+	void startQueued();
+	void dropQueued(DecodeJob* job);
+
+	//released in this order by the destructor, the callback only after the codec that calls it
+	SdkRef<IBlackmagicRaw> codec;
+	SdkRef<IBlackmagicRawFactory> factory;
+	SdkRef<IBlackmagicRawConfiguration> config;
+	SdkRef<CameraCodecCallback> callback;
+	bool pinThreads = false;
+	GROUP_AFFINITY workerAffinity = {};
+	ProcessorOptions options;
+	std::mutex metadataLock;
+	std::unique_ptr<FileReadAhead> fileReadAhead;
+	std::unique_ptr<CompressedCache> compressedCache;
+	//opens all but the first file in the background, see openSegments
+	std::thread opener;
+
+	//codec pipeline warm up, PreparePipelineComplete arrives on an sdk thread
+	std::mutex pipelineLock;
+	std::condition_variable pipelineDone;
+	bool pipelinePending = false;
+	HRESULT pipelineResult = S_OK;
+
+	//jobs in flight, all guarded by jobLock
+	std::mutex jobLock;
+	std::condition_variable jobCopied;
+	std::multimap<unsigned long long, DecodeJob*> jobs; //not copying yet, sources can still join
+	std::deque<DecodeJob*> queued;                      //read ahead not handed to the sdk yet, oldest first
+	int startedJobs = 0;                                //handed to the sdk and not completed
+	std::map<BRAWSDKProcessor*, int> copying;           //copies into a source that are running
+	BlackmagicRawResourceFormat resourceFormat = blackmagicRawResourceFormatBGRAU8;
+	BlackmagicRawResolutionScale resolutionScale = blackmagicRawResolutionScaleEighth;
+	bool metadata = false;
+};
 
 class BRAWSDKProcessor {
-	
+	/* one source: output format, region, LUT and its own cache of finished frames. reading and decoding is done
+	   by the decoder, which may be shared with other sources on the same files */
 public:
-	
+
     ~BRAWSDKProcessor();
 	unsigned long long frameCount = 0;
     unsigned int width;
@@ -26,20 +490,85 @@ public:
     float framerate;
     int framerate_num;
     int framerate_den;
-    
+
     uint64_t audioSamples;
     uint32_t audioBitDepth;
     uint32_t channelCount;
     uint32_t sampleRate;
 
-	HRESULT openFile(BSTR fileName, int bitmode);
-    bool* getFrameByNum(int frameNum, uint8_t* framebuffer);
+	HRESULT openFile(const std::vector<std::string>& fileNames, int bitmode, const ProcessorOptions& options = ProcessorOptions());
+    std::shared_ptr<DecodedFrame> fetchFrame(int frameNum, const OutputAllocator& allocate);
     void getAudioSamples(void* buf, int64_t start, int64_t count);
+    //decodes the first count frames of the range in the background, call after setRange
+    void warmUp(const OutputAllocator& allocate, unsigned long long count = 1);
+
+    //subclip, frame and audio sample numbers given to fetchFrame and getAudioSamples are relative to it.
+    //with step > 1 frame n of the range is clip frame first + n * step
+    void setRange(unsigned long long first, unsigned long long last, unsigned long long step = 1);
+    long long frameForTimecode(const char* timecode);
+    unsigned long long rangeFirst = 0;
+    unsigned long long rangeFrames = 0;
+    unsigned long long rangeStep = 1;
+    int64_t rangeAudioFirst = 0;
+    int64_t rangeAudioSamples = 0;
+    PrefetchStats prefetchStats();
+    FileReadStats fileReadStats();
+    CompressedCacheStats compressedCacheStats();
+    QcStats qcSummary();           //all frames of this source delivered so far
+    size_t frameSizeBytes();
+    size_t maxHeldFrames();        //output frames the fetch layer holds at most, within the memory budget
+
+    //called by the decoder from sdk threads, once per source that joined the job
+    void frameProcessed(std::shared_ptr<DecodedFrame>& frame, const DecodeJob& job, HRESULT result, IBlackmagicRawProcessedImage* img);
+
+    BlackmagicRawResourceFormat resourceFormat;
+    BlackmagicRawResolutionScale resolutionScale = blackmagicRawResolutionScaleFull; //smallest decode this source can be made from
+    uint32_t decodeWidth = 0;      //size of the processed image at that scale, width/height is the output size
+    uint32_t decodeHeight = 0;
+
+private:
+
+    struct Geometry {
+        /* where the output comes from in a processed image of one size */
+        uint32_t decodeWidth = 0;
+        uint32_t decodeHeight = 0;
+        uint32_t roiLeft = 0;      //crop without resize, in decoded pixels
+        uint32_t roiTop = 0;
+        std::shared_ptr<const Resampler> resampler;
+    };
+
+    void loadLut();
+    void chooseGeometry();
+    std::shared_ptr<const Geometry> geometryFor(uint32_t w, uint32_t h);
+    void applyLut(const uint8_t* const src[3], uint8_t* const dst[3], uint32_t count);
+
+    void submitFrame(std::shared_ptr<DecodedFrame>& frame);
+    void evictFrames(unsigned long long clipFrame);
+    void copyToOutput(const uint8_t* src, BlackmagicRawResourceFormat srcFormat, const Geometry& geometry, OutputFrame& out, QcStats* qc);
+
+    std::shared_ptr<BRawDecoder> decoder;
+    ProcessorOptions options;
+    std::unique_ptr<PrefetchGovernor> governor;
+    std::unique_ptr<Lut3D> lut;
+
+    //region of the recorded picture
+    int cropLeft = 0;
+    int cropTop = 0;
+    int cropWidth = 0;
+    int cropHeight = 0;
+    bool resize = false;
+    std::mutex geometryLock;
+    std::map<std::pair<uint32_t, uint32_t>, std::shared_ptr<const Geometry>> geometries; //by decoded size
 
-    IBlackmagicRaw* codec = nullptr;
-    IBlackmagicRawClip* clip = nullptr;
-    IBlackmagicRawFactory* factory = nullptr;
-    IBlackmagicRawConfiguration* config = nullptr;
+    //fetch layer, all guarded by fetchLock
+    std::mutex fetchLock;
+    std::condition_variable frameDone;
+    std::map<unsigned long long, std::shared_ptr<DecodedFrame>> frames;
+    unsigned long long useCounter = 0;
+    long long lastRequested = -1;
+    bool lastSequential = true;
+    QcStats clipQc;
+    std::set<unsigned long long> qcCounted;
 
 };
-#endif
\ No newline at end of file
+#endif
@@ -34,9 +34,12 @@
 #include <cinttypes>
 #include <malloc.h>
 #include "common.h"
+#include "frameserver.h"
+#include <avisynth.h>
 
 #include <comutil.h>
 #include <stdio.h>
+#include <cctype>
 
 //logging
 #include<string>
@@ -45,6 +48,8 @@
 #pragma comment(lib, "comsuppw.lib")
 #pragma comment(lib, "kernel32.lib")
 
+typedef IScriptEnvironment ise_t;
+
 #pragma region debugging
 static inline std::string getCurrentDateTime(std::string s) {
     time_t now = time(0);
@@ -81,7 +86,7 @@ class BRawAudioSource : public IClip {
 
 public:
 
-    BRawAudioSource(const char* source, int bitmode, ise_t* env);
+    BRawAudioSource(std::shared_ptr<BRAWSDKProcessor> proc, std::shared_ptr<FrameClient> client, ise_t* env);
 
     ~BRawAudioSource() {
     }
@@ -91,26 +96,37 @@ public:
     PVideoFrame __stdcall GetFrame(int n, ise_t* env) { return nullptr; };
 
     const VideoInfo& __stdcall GetVideoInfo() { return vi; }
-    int __stdcall SetCacheHints(int cachehints, int frame_range) { return 0; }
+    int __stdcall SetCacheHints(int cachehints, int frame_range) { return cachehints == CACHE_GET_MTMODE ? MT_SERIALIZED : 0; }
 
     //non avisynth fields and funcs
-    BRAWSDKProcessor* bmdaudioproc;
-    int bitmode = 8;
+    std::shared_ptr<BRAWSDKProcessor> bmdaudioproc;
+    std::shared_ptr<FrameClient> client; //server=true, samples come from the server session
 
 };
 
-BRawAudioSource::BRawAudioSource(const char* source, int bitmode, ise_t* env) {
+BRawAudioSource::BRawAudioSource(std::shared_ptr<BRAWSDKProcessor> proc, std::shared_ptr<FrameClient> client, ise_t* env) {
     Logger("Audio Source init start");
-    this->bmdaudioproc = new BRAWSDKProcessor();
-    BSTR bstrText = _com_util::ConvertStringToBSTR(source);
-    this->bmdaudioproc->openFile(bstrText, bitmode);
+    //shares the already opened clip of the video source, no second open
+    this->bmdaudioproc = proc;
+    this->client = client;
+    memset(&vi, 0, sizeof(VideoInfo));
     //audio:
    
-    vi.nchannels = bmdaudioproc->channelCount;
-    vi.num_audio_samples = bmdaudioproc->audioSamples;
-    vi.audio_samples_per_second = bmdaudioproc->sampleRate;
+    uint32_t audioBitDepth = 0;
+    if (client) {
+        vi.nchannels = client->info.channelCount;
+        vi.num_audio_samples = client->info.rangeAudioSamples;
+        vi.audio_samples_per_second = client->info.sampleRate;
+        audioBitDepth = client->info.audioBitDepth;
+    }
+    else {
+        vi.nchannels = bmdaudioproc->channelCount;
+        vi.num_audio_samples = bmdaudioproc->rangeAudioSamples;
+        vi.audio_samples_per_second = bmdaudioproc->sampleRate;
+        audioBitDepth = bmdaudioproc->audioBitDepth;
+    }
     
-    switch (bmdaudioproc->audioBitDepth) {
+    switch (audioBitDepth) {
         case 8:
             vi.sample_type = SAMPLE_INT8;
             break;
@@ -134,7 +150,10 @@ BRawAudioSource::BRawAudioSource(const char* source, int bitmode, ise_t* env) {
 void __stdcall BRawAudioSource::GetAudio(void* buf, int64_t start, int64_t count, ise_t* env) {
     bool debughere = true;
     try {
-        bmdaudioproc->getAudioSamples(buf, start, count);
+        if (client)
+            client->readAudio(buf, start, count);
+        else
+            bmdaudioproc->getAudioSamples(buf, start, count);
     }
    catch (std::runtime_error& e) {
          env->ThrowError("BRawSource: %s", e.what());
@@ -145,6 +164,29 @@ void __stdcall BRawAudioSource::GetAudio(void* buf, int64_t start, int64_t count
 
 #pragma region videosource
 
+class AvsOutputFrame : public OutputFrame {
+    /* avisynth frame as destination for the bmd copy stage, lives in the prefetch cache until handed out */
+public:
+    PVideoFrame frame;
+
+    AvsOutputFrame(PVideoFrame dst, int bitmode) : frame(dst) {
+        if (bitmode == 8) {
+            //avisynth RGB32 is bottom up, bmd BGRA top down: rows are written from the last one upwards, no FlipVertical needed
+            numPlanes = 1;
+            pitches[0] = -frame->GetPitch();
+            planes[0] = frame->GetWritePtr() - (ptrdiff_t)(frame->GetHeight() - 1) * pitches[0];
+            return;
+        }
+        //planar bmd output is R,G,B, written straight into the matching avisynth planes
+        const int order[3] = { PLANAR_R, PLANAR_G, PLANAR_B };
+        numPlanes = 3;
+        for (int p = 0; p < 3; p++) {
+            planes[p] = frame->GetWritePtr(order[p]);
+            pitches[p] = frame->GetPitch(order[p]);
+        }
+    }
+};
+
 class BRawSource : public IClip {
     
     VideoInfo vi;
@@ -155,7 +197,7 @@ class BRawSource : public IClip {
 
 public:
 
-    BRawSource(const char *source,int bitmode, ise_t* env);
+    BRawSource(const std::vector<std::string>& files, int bitmode, bool stats, const ProcessorOptions& options, const AVSValue& start, const AVSValue& end, int step, bool server, ise_t* env);
     
     ~BRawSource() {}
 
@@ -163,26 +205,91 @@ public:
     void __stdcall GetAudio(void* buf, int64_t start, int64_t count, ise_t* env);
     PVideoFrame __stdcall GetFrame(int n, ise_t* env);
     const VideoInfo& __stdcall GetVideoInfo() { return vi; }
-    int __stdcall SetCacheHints(int cachehints,int frame_range) { return 0; }
+    int __stdcall SetCacheHints(int cachehints, int frame_range) { return cachehints == CACHE_GET_MTMODE ? MT_SERIALIZED : 0; }
 
     //non avisynth fields and funcs
-    BRAWSDKProcessor* bmdproc;
-    BRawAudioSource* AudioSource;
+    std::shared_ptr<BRAWSDKProcessor> bmdproc;
+    std::shared_ptr<FrameClient> client; //server=true, decoding happens in the brawsource server process
+    PClip AudioSource;             //owned here as well, sampled clips (BRawThumbs) never hand it to AudioDubEx
     
     int bitmode = 8;
+    int step = 1;
+    bool stats = false;
+    bool metadata = false;
+    bool qc = false;
     PClip PostInit(ise_t* env);
+    PVideoFrame GetServerFrame(int n, ise_t* env);
+    void SetStatsProps(PVideoFrame& dst, const DecodedFrame& frame, ise_t* env);
+    void SetMetadataProps(PVideoFrame& dst, const DecodedFrame& frame, ise_t* env);
+    void SetQcProps(PVideoFrame& dst, const DecodedFrame& frame, ise_t* env);
 
 };
 
 
-BRawSource::BRawSource (const char *source, int bitmode, ise_t* env)
+static long long FramePosition(const AVSValue& pos, BRAWSDKProcessor& proc, long long def) {
+    //start/end can be a frame number or a timecode string
+    if (!pos.Defined())
+        return def;
+    if (pos.IsInt())
+        return pos.AsInt();
+    if (pos.IsString())
+        return proc.frameForTimecode(pos.AsString());
+    throw std::runtime_error("start and end must be a frame number or a timecode like \"01:00:10:00\"");
+}
+
+static std::string ServerFramePosition(const AVSValue& pos) {
+    //resolved by the server, which has the clip open
+    if (!pos.Defined())
+        return "";
+    if (pos.IsInt())
+        return std::to_string(pos.AsInt());
+    if (pos.IsString())
+        return pos.AsString();
+    throw std::runtime_error("start and end must be a frame number or a timecode like \"01:00:10:00\"");
+}
+
+BRawSource::BRawSource (const std::vector<std::string>& files, int bitmode, bool stats, const ProcessorOptions& options, const AVSValue& start, const AVSValue& end, int step, bool server, ise_t* env)
 {
     Logger("BRawSource init start");
     this->bitmode = bitmode;
-    this->bmdproc = new BRAWSDKProcessor();
-    //const char* source = args[0].AsString();
-    BSTR bstrText = _com_util::ConvertStringToBSTR(source);
-    this->bmdproc->openFile(bstrText, bitmode);
+    this->step = step;
+    this->stats = stats;
+    this->metadata = options.metadata;
+    this->qc = options.qc;
+
+    if (server) {
+        //the server opens the clip (or hands out a warm session of the same request) and keeps it decoding
+        ServerOpenRequest request;
+        request.files = files;
+        request.bitmode = bitmode;
+        request.options = options;
+        request.start = ServerFramePosition(start);
+        request.end = ServerFramePosition(end);
+        request.step = step;
+        this->client = std::make_shared<FrameClient>(request);
+
+        memset(&vi, 0, sizeof(VideoInfo));
+        vi.width = this->client->info.width;
+        vi.height = this->client->info.height;
+        vi.SetFPS(this->client->info.framerateNum, this->client->info.framerateDen);
+        vi.SetFieldBased(false);
+        vi.pixel_type = bitmode == 8 ? VideoInfo::CS_BGR32 : bitmode == 16 ? VideoInfo::CS_RGBP16 : VideoInfo::CS_RGBPS;
+        vi.num_frames = (int)this->client->info.rangeFrames;
+
+        this->AudioSource = new BRawAudioSource(nullptr, this->client, env);
+        Logger("BRawSource init done");
+        return;
+    }
+
+    this->bmdproc = std::make_shared<BRAWSDKProcessor>();
+    //several files are presented as one clip with a global frame index
+    this->bmdproc->openFile(files, bitmode, options);
+
+    //subclip, everything below (frames, audio, read ahead) stays inside of it
+    long long first = FramePosition(start, *this->bmdproc, 0);
+    long long last = FramePosition(end, *this->bmdproc, (long long)this->bmdproc->frameCount - 1);
+    validate(first < 0 || last < 0, "start/end is before the first frame of the clip");
+    this->bmdproc->setRange(first, last, step);
 
     const int width = this->bmdproc->width;
     const int height = this->bmdproc->height;
@@ -204,43 +311,36 @@ BRawSource::BRawSource (const char *source, int bitmode, ise_t* env)
         vi.pixel_type = VideoInfo::CS_BGR32; //matches blackmagicRawResourceFormatBGRAU8
     }
     if (this->bitmode == 16) {
-        vi.pixel_type = VideoInfo::CS_RGBP16; //blackmagicRawResourceFormatRGBU16Planar == RGBP16, must apply  CombinePlanes( planes="RGB", source_planes="GBR",  pixel_type="RGBP16")
+        vi.pixel_type = VideoInfo::CS_RGBP16; //blackmagicRawResourceFormatRGBU16Planar, planes are mapped in AvsOutputFrame
     }
     if (this->bitmode == 32) {
-        vi.pixel_type = VideoInfo::CS_RGBAPS; //blackmagicRawResourceFormatRGBF32Planar;// == RGBAPS, must apply  CombinePlanes( planes="RGB", source_planes="GBR",  pixel_type="RGBPS")
+        vi.pixel_type = VideoInfo::CS_RGBPS; //blackmagicRawResourceFormatRGBF32Planar, planes are mapped in AvsOutputFrame
     }
     
     size_t framesize = vi.width * vi.height * vi.BitsPerPixel() / 8;
 
-    vi.num_frames = this->bmdproc->frameCount;
+    vi.num_frames = (int)this->bmdproc->rangeFrames;
 
-    this->AudioSource = new BRawAudioSource(source, bitmode, env);
+    this->AudioSource = new BRawAudioSource(this->bmdproc, nullptr, env);
+
+    //the first frame decodes while avisynth goes on with the rest of the script,
+    //sampled frames (BRawThumbs) are all submitted at once and decode in parallel
+    this->bmdproc->warmUp([this, env]() {
+        return std::make_shared<AvsOutputFrame>(env->NewVideoFrame(vi), this->bitmode);
+    }, step > 1 ? this->bmdproc->rangeFrames : 1);
     
     Logger("BRawSource init done");
 }
 
 PClip BRawSource::PostInit(ise_t* env) {
-    //apply pix format filters mapping between bmd and avisynth, apply audio
+    //apply audio, flip and plane order are already done by the copy out of the sdk
 
     Logger("PostInit init start");
-    PClip final_clip;
-    if (this->bitmode == 8) {
-        //blackmagicRawResourceFormatBGRAU8 which matches BGRA, must be flipped
-        AVSValue avsv[1] = { this };
-        final_clip = env->Invoke("FlipVertical", AVSValue(avsv, 1)).AsClip();
-    }
-    if (this->bitmode == 16) {
-        // blackmagicRawResourceFormatRGBU16Planar which matches RGBP16 but B and R Planes must be switched as bmd returns BGR not RGB
-        const char* names[] = { NULL, "planes", "source_planes", "pixel_type" };
-        AVSValue avsv[4] = { this,"RGB","GBR","RGBP16" };
-        final_clip = env->Invoke("CombinePlanes", AVSValue(avsv, 4), names).AsClip();
-    }
-    if (this->bitmode == 32) {
-       // blackmagicRawResourceFormatRGBF32Planar which matches RGBAPS but B and R Planes must be switched as bmd returns BGR not RGB
-        const char* names[] = { NULL, "planes", "source_planes", "pixel_type" };
-        AVSValue avsv[4] = { this,"RGB","GBR","RGBPS"};
-        final_clip = env->Invoke("CombinePlanes", AVSValue(avsv, 4),names).AsClip();
-    }
+    PClip final_clip = this;
+
+    //sampled frames have no audio that belongs to them
+    if (this->step > 1)
+        return final_clip;
 
     //add audio
     AVSValue ADArgs[] = { final_clip, this->AudioSource };
@@ -255,22 +355,148 @@ void __stdcall BRawSource::GetAudio(void* buf, int64_t start, int64_t count, ise
     
 }
 
+void BRawSource::SetStatsProps(PVideoFrame& dst, const DecodedFrame& frame, ise_t* env) {
+    //exposes the prefetch governor decisions, needs avisynth+ frame properties (interface v8)
+    PrefetchStats st = this->bmdproc->prefetchStats();
+    FileReadStats io = this->bmdproc->fileReadStats();
+    CompressedCacheStats compressed = this->bmdproc->compressedCacheStats();
+    AVSMap* props = env->getFramePropsRW(dst);
+    env->propSetInt(props, "BRawReadAhead", frame.readAhead ? 1 : 0, PROPAPPENDMODE_REPLACE);
+    env->propSetFloat(props, "BRawReadMs", frame.readMs, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawFileReadAheadMB", (int64_t)(io.bytesRead >> 20), PROPAPPENDMODE_REPLACE);
+    env->propSetFloat(props, "BRawFileReadAheadMs", io.readMs, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawCompressedHit", frame.compressedHit ? 1 : 0, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawCompressedCacheMB", (int64_t)(compressed.bytes >> 20), PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawCompressedCacheFrames", (int64_t)compressed.frames, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawSharedDecode", frame.sharedDecode ? 1 : 0, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawPrefetchDepth", st.depth, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawCacheFrames", st.cacheFrames, PROPAPPENDMODE_REPLACE);
+    env->propSetFloat(props, "BRawDecodeMs", st.decodeMs, PROPAPPENDMODE_REPLACE);
+    env->propSetFloat(props, "BRawRequestIntervalMs", st.intervalMs, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawAvailMemMB", (int64_t)st.availMB, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawBudgetMB", (int64_t)st.budgetMB, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawMemoryLimited", st.memoryLimited ? 1 : 0, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawCacheHits", (int64_t)st.hits, PROPAPPENDMODE_REPLACE);
+    env->propSetInt(props, "BRawCacheMisses", (int64_t)st.misses, PROPAPPENDMODE_REPLACE);
+}
+
+static void SetMetadataProp(AVSMap* props, const MetadataValue& value, ise_t* env) {
+    //camera keys like "lens_type" become "BRaw_lens_type"
+    std::string key = "BRaw_" + value.key;
+    for (char& c : key) {
+        if (!isalnum((unsigned char)c))
+            c = '_';
+    }
+
+    if (value.type == MetadataValue::String)
+        env->propSetData(props, key.c_str(), value.text.c_str(), (int)value.text.size(), PROPAPPENDMODE_REPLACE);
+    else if (value.type == MetadataValue::Float)
+        env->propSetFloatArray(props, key.c_str(), value.floats.data(), (int)value.floats.size());
+    else
+        env->propSetIntArray(props, key.c_str(), value.ints.data(), (int)value.ints.size());
+}
+
+void BRawSource::SetMetadataProps(PVideoFrame& dst, const DecodedFrame& frame, ise_t* env) {
+    //clip values first, per frame values of the same key win
+    AVSMap* props = env->getFramePropsRW(dst);
+    if (frame.clipMetadata) {
+        for (const MetadataValue& value : *frame.clipMetadata)
+            SetMetadataProp(props, value, env);
+    }
+    for (const MetadataValue& value : frame.frameMetadata)
+        SetMetadataProp(props, value, env);
+
+    if (!frame.timecode.empty())
+        env->propSetData(props, "BRawTimecode", frame.timecode.c_str(), (int)frame.timecode.size(), PROPAPPENDMODE_REPLACE);
+}
+
+static void SetQcStatsProps(AVSMap* props, const char* prefix, const QcStats& qc, ise_t* env) {
+    //R,G,B arrays, normalized to 0..1
+    std::string key(prefix);
+    double values[3];
+    int64_t counts[3];
+
+    for (int c = 0; c < 3; c++)
+        values[c] = qc.pixels > 0 ? qc.min[c] : 0;
+    env->propSetFloatArray(props, (key + "Min").c_str(), values, 3);
+    for (int c = 0; c < 3; c++)
+        values[c] = qc.pixels > 0 ? qc.max[c] : 0;
+    env->propSetFloatArray(props, (key + "Max").c_str(), values, 3);
+    for (int c = 0; c < 3; c++)
+        counts[c] = (int64_t)qc.clippedLow[c];
+    env->propSetIntArray(props, (key + "ClippedLow").c_str(), counts, 3);
+    for (int c = 0; c < 3; c++)
+        counts[c] = (int64_t)qc.clippedHigh[c];
+    env->propSetIntArray(props, (key + "ClippedHigh").c_str(), counts, 3);
+    env->propSetFloat(props, (key + "AverageLuma").c_str(), qc.averageLuma(), PROPAPPENDMODE_REPLACE);
+}
+
+void BRawSource::SetQcProps(PVideoFrame& dst, const DecodedFrame& frame, ise_t* env) {
+    //this frame, and the summary over all frames delivered so far
+    AVSMap* props = env->getFramePropsRW(dst);
+    SetQcStatsProps(props, "BRawQc", frame.qc, env);
+
+    int64_t histogram[s_qcBins];
+    for (int i = 0; i < s_qcBins; i++)
+        histogram[i] = (int64_t)frame.qc.histogram[i];
+    env->propSetIntArray(props, "BRawQcHistogram", histogram, s_qcBins);
+
+    QcStats clip = this->bmdproc->qcSummary();
+    SetQcStatsProps(props, "BRawQcClip", clip, env);
+    env->propSetInt(props, "BRawQcClipFrames", (int64_t)clip.frames, PROPAPPENDMODE_REPLACE);
+}
+
+PVideoFrame BRawSource::GetServerFrame(int n, ise_t* env) {
+    //the frame waits in a shared memory slot of the server, copied once into the avisynth frame
+    PVideoFrame dst = env->NewVideoFrame(vi);
+    try {
+        this->client->fetchFrame(n, [&](const uint8_t* const* planes, int pitch) {
+            if (this->bitmode == 8) {
+                //slot is top down, avisynth RGB32 bottom up
+                env->BitBlt(dst->GetWritePtr(), dst->GetPitch(), planes[0] + (ptrdiff_t)(vi.height - 1) * pitch, -pitch, dst->GetRowSize(), vi.height);
+                return;
+            }
+            const int order[3] = { PLANAR_R, PLANAR_G, PLANAR_B };
+            for (int p = 0; p < 3; p++)
+                env->BitBlt(dst->GetWritePtr(order[p]), dst->GetPitch(order[p]), planes[p], pitch, dst->GetRowSize(order[p]), vi.height);
+        });
+    }
+    catch (std::runtime_error& e) {
+        env->ThrowError("BRawSource: %s", e.what());
+    }
+    return dst;
+}
+
 PVideoFrame __stdcall BRawSource::GetFrame(int n, ise_t* env)
 {
     Logger("GetFrame start");
-    //create new avisynth frame
-    PVideoFrame dst = env->NewVideoFrame(vi);
-    
-    //get write pointer for avs frame
-    uint8_t* dstp = dst->GetWritePtr();
 
-    //kick off bmd decoding job, hand over avisynth frame buffer pointer
-    bool * job_done = this->bmdproc->getFrameByNum(n, dstp);
+    if (this->client)
+        return GetServerFrame(n, env);
 
-    //waits until bmd ProcessComplete. //todo: error handling or timeout needed?
-    while (!*job_done) {
-    	std::this_thread::sleep_for(std::chrono::microseconds(100));
+    //the fetch layer creates avisynth frames for the requested frame and for everything it decides to read ahead
+    OutputAllocator allocate = [this, env]() {
+        return std::make_shared<AvsOutputFrame>(env->NewVideoFrame(vi), this->bitmode);
+    };
+
+    std::shared_ptr<DecodedFrame> frame;
+    try {
+        //waits until bmd ProcessComplete, read ahead frames are usually done already
+        frame = this->bmdproc->fetchFrame(n, allocate);
     }
+    catch (std::runtime_error& e) {
+        env->ThrowError("BRawSource: %s", e.what());
+    }
+
+    PVideoFrame dst = static_cast<AvsOutputFrame*>(frame->output.get())->frame;
+
+    //properties are only written when the frame leaves us the first time, later it may be shared
+    if (this->stats && frame->deliveries == 1)
+        SetStatsProps(dst, *frame, env);
+    if (this->metadata && frame->deliveries == 1)
+        SetMetadataProps(dst, *frame, env);
+    if (this->qc && frame->deliveries == 1)
+        SetQcProps(dst, *frame, env);
 
     Logger("GetFrame done");
     return dst;
@@ -280,6 +506,16 @@ PVideoFrame __stdcall BRawSource::GetFrame(int n, ise_t* env)
 
 #pragma region avisnyth init
 
+static bool HasFrameProps(ise_t* env) {
+    try {
+        env->CheckVersion(8);
+    }
+    catch (const AvisynthError&) {
+        return false;
+    }
+    return true;
+}
+
 AVSValue __cdecl initiate_everything(AVSValue args, void* user_data, ise_t* env)
 {
     char buff[128] = {};
@@ -296,9 +532,75 @@ AVSValue __cdecl initiate_everything(AVSValue args, void* user_data, ise_t* env)
         }
         validate(!(bitmode==8|| bitmode==16|| bitmode==32), "bit parameter must be 8,16 or 32");
 
+        bool hasFrameProps = HasFrameProps(env);
+
+        bool stats = args[2].AsBool(false);
+        validate(stats && !hasFrameProps, "stats=true needs Avisynth+ with frame property support");
+
+        ProcessorOptions options;
+        options.threads = args[3].AsInt(0);
+        options.numaNode = args[4].AsInt(-1);
+        options.affinity = args[5].AsString("");
+        validate(options.threads < 0, "threads must be 0 (sdk default) or more");
+
+        //raw processing, everything not given stays as recorded by the camera
+        options.setIso = args[9].Defined();
+        options.iso = args[9].AsInt(0);
+        options.setKelvin = args[10].Defined();
+        options.kelvin = args[10].AsInt(0);
+        options.setTint = args[11].Defined();
+        options.tint = args[11].AsInt(0);
+        options.setExposure = args[12].Defined();
+        options.exposure = args[12].AsFloatf(0);
+        options.gamma = args[13].AsString("");
+        options.gamut = args[14].AsString("");
+        validate(options.setIso && args[9].AsInt() <= 0, "iso must be positive");
+        validate(options.setKelvin && args[10].AsInt() <= 0, "kelvin must be positive");
+
+        //3d lut fused into the copy out of the sdk
+        options.lut = args[15].AsString("");
+
+        //camera metadata as frame properties, on by default where avisynth supports them
+        //frames of the server come without properties
+        bool server = args[22].AsBool(false);
+        validate(server && stats, "stats=true is not available with server=true");
+
+        options.metadata = args[16].AsBool(hasFrameProps && !server);
+        validate(options.metadata && !hasFrameProps, "metadata=true needs Avisynth+ with frame property support");
+        validate(options.metadata && server, "metadata=true is not available with server=true");
+
+        //crop and resize in the copy out of the sdk, decoded at reduced resolution where that is enough
+        if (args[17].Defined()) {
+            options.crop = true;
+            validate(sscanf(args[17].AsString(), "%d,%d,%d,%d", &options.cropLeft, &options.cropTop, &options.cropWidth, &options.cropHeight) != 4,
+                "crop must be \"left,top,width,height\" like Crop(), e.g. \"960,540,-960,-540\"");
+        }
+        if (args[18].Defined()) {
+            const char* size = args[18].AsString();
+            validate(sscanf(size, "%dx%d", &options.resizeWidth, &options.resizeHeight) != 2 && sscanf(size, "%d,%d", &options.resizeWidth, &options.resizeHeight) != 2,
+                "resize must be \"widthxheight\", e.g. \"1920x1080\" or \"1920x0\" to keep the aspect ratio");
+            validate(options.resizeWidth < 0 || options.resizeHeight < 0 || (options.resizeWidth == 0 && options.resizeHeight == 0), "resize width and height must be positive");
+        }
+
+        //file list, wildcard or card span
+        std::vector<std::string> files = expandSources(args[0].AsString(), args[8].AsBool(false));
+        validate(files.empty(), "No source specified");
+
+        //read ahead on the file level only pays off where every read is a network round trip
+        options.readAheadMB = args[19].AsInt(isNetworkPath(files[0]) ? 256 : 0);
+        validate(options.readAheadMB < 0, "readahead_mb must be 0 (off) or more");
+
+        //compressed frames are small, scrubbing back only pays the decode. one budget for all sources of the process
+        options.compressedCacheMB = args[20].AsInt(1024);
+        validate(options.compressedCacheMB < 0, "compressed_cache_mb must be 0 (off) or more");
+
+        //picture statistics gathered while the frame is copied out of the sdk
+        options.qc = args[21].AsBool(false);
+        validate(options.qc && !hasFrameProps, "qc=true needs Avisynth+ with frame property support");
+        validate(options.qc && server, "qc=true is not available with server=true");
+
         //calls BMD SDK to open and analyze the file properties
-        const char* source = args[0].AsString();
-        BRawSource * brawsource = new BRawSource(source, bitmode, env);
+        BRawSource * brawsource = new BRawSource(files, bitmode, stats, options, args[6], args[7], 1, server, env);
         PClip postInitClip = brawsource->PostInit(env);
 
         return postInitClip;
@@ -309,8 +611,43 @@ AVSValue __cdecl initiate_everything(AVSValue args, void* user_data, ise_t* env)
     return 0;
 }
 
+AVSValue __cdecl initiate_thumbs(AVSValue args, void* user_data, ise_t* env)
+{
+    try {
+        validate(!args[0].Defined(), "No source specified");
+
+        int step = args[1].AsInt(250);
+        validate(step < 1, "step must be 1 or more");
+
+        int bitmode = args[3].AsInt(8);
+        validate(!(bitmode == 8 || bitmode == 16 || bitmode == 32), "bit parameter must be 8,16 or 32");
+
+        //previews are decoded small, the sdk does far less work than for a full frame
+        ProcessorOptions options;
+        options.scale = args[2].AsInt(8);
+        options.metadata = HasFrameProps(env);
+
+        std::vector<std::string> files = expandSources(args[0].AsString(), args[4].AsBool(false));
+        validate(files.empty(), "No source specified");
+
+        BRawSource* brawsource = new BRawSource(files, bitmode, false, options, AVSValue(), AVSValue(), step, false, env);
+        return brawsource->PostInit(env);
+
+    }
+    catch (std::runtime_error& e) {
+        env->ThrowError("BRawThumbs: %s", e.what());
+    }
+    return 0;
+}
+
 const AVS_Linkage* AVS_linkage = nullptr;
 
+//entry point of the frame server process: rundll32 BRawSource.dll,BRawServer
+extern "C" __declspec(dllexport) void CALLBACK BRawServer(HWND, HINSTANCE, LPSTR, int)
+{
+    runFrameServer();
+}
+
 
 extern "C" __declspec(dllexport) const char* __stdcall
 AvisynthPluginInit3(ise_t* env, const AVS_Linkage* const vectors)
@@ -319,13 +656,40 @@ AvisynthPluginInit3(ise_t* env, const AVS_Linkage* const vectors)
 
     const char* args =
         "[file]s"
-        "[bits]i";
-        /*
-        "[lutpath]s" //we cand potentially support extracting embedded LUT to file
-        */
+        "[bits]i"
+        "[stats]b"
+        "[threads]i"
+        "[numa_node]i"
+        "[affinity]s"
+        "[start]."
+        "[end]."
+        "[span]b"
+        "[iso]i"
+        "[kelvin]i"
+        "[tint]i"
+        "[exposure]f"
+        "[gamma]s"
+        "[gamut]s"
+        "[lut]s"
+        "[metadata]b"
+        "[crop]s"
+        "[resize]s"
+        "[readahead_mb]i"
+        "[compressed_cache_mb]i"
+        "[qc]b"
+        "[server]b";
 
     env->AddFunction("BRawSource", args, initiate_everything, nullptr);
 
+    const char* thumbArgs =
+        "[file]s"
+        "[step]i"
+        "[scale]i"
+        "[bits]i"
+        "[span]b";
+
+    env->AddFunction("BRawThumbs", thumbArgs, initiate_thumbs, nullptr);
+
     return "BRawSource for AviSynth2.6x/Avisynth+.";
 }
 
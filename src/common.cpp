@@ -8,10 +8,26 @@ for avisynth2.6x/Avisynth+.
 */
 
 
+#include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <string>
 #include "common.h"
 
+#ifdef _WIN32
+#include <intrin.h>
+
+EXTERN_C IMAGE_DOS_HEADER __ImageBase;
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#include <fstream>
+#endif
+
 // Function to compute the greatest common divisor (GCD)
 int gcd(int a, int b) {
 	return b == 0 ? a : gcd(b, a % b);
@@ -40,6 +56,364 @@ void floatToFraction(float number, int& numerator, int& denominator) {
 	numerator /= commonDivisor;
 	denominator /= commonDivisor;
 }
+
+// Timecode HH:MM:SS:FF to frames at a rounded fps. ; or . before the frames is drop frame timecode (29.97 and 59.94),
+// it skips the first 2 (4 at 59.94) frame numbers of every minute except every tenth minute
+bool parseTimecode(const char* timecode, int fps, long long& frames) {
+	int hh, mm, ss, ff;
+	char sep;
+	if (fps <= 0 || sscanf(timecode, "%d:%d:%d%c%d", &hh, &mm, &ss, &sep, &ff) != 5)
+		return false;
+	if (sep != ':' && sep != ';' && sep != '.')
+		return false;
+	if (hh < 0 || mm < 0 || mm > 59 || ss < 0 || ss > 59 || ff < 0 || ff >= fps)
+		return false;
+
+	long long minutes = (long long)hh * 60 + mm;
+	frames = (minutes * 60 + ss) * fps + ff;
+	if (sep == ':')
+		return true;
+
+	//drop frame only exists at 30 and 60 nominal fps, the skipped frame numbers do not exist
+	if (fps != 30 && fps != 60)
+		return false;
+	int dropped = fps / 15;
+	if (ss == 0 && ff < dropped && mm % 10 != 0)
+		return false;
+	frames -= dropped * (minutes - minutes / 10);
+	return true;
+}
+
+static bool fileExists(const std::string& path) {
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributes(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+#endif
+}
+
+// Files of a span continue the trailing number of the first file: clip_001.braw, clip_002.braw, ...
+static void addSpanFiles(std::vector<std::string>& files) {
+	const std::string first = files.back();
+	size_t dot = first.find_last_of('.');
+	size_t slash = first.find_last_of("\\/");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return;
+
+	size_t digits = dot;
+	while (digits > 0 && isdigit((unsigned char)first[digits - 1]))
+		digits--;
+	if (digits == dot)
+		return;
+
+	std::string prefix = first.substr(0, digits);
+	std::string extension = first.substr(dot);
+	size_t width = dot - digits;
+	long long number = std::stoll(first.substr(digits, width));
+
+	for (;;) {
+		std::string next = std::to_string(++number);
+		if (next.size() < width)
+			next.insert(0, width - next.size(), '0');
+		std::string path = prefix + next + extension;
+		if (!fileExists(path))
+			break;
+		files.push_back(path);
+	}
+}
+
+// Source list: files separated by |, each may be a wildcard pattern (sorted by name).
+// With span, a single file is extended by the following files of its card span.
+std::vector<std::string> expandSources(const char* source, bool span) {
+	std::vector<std::string> files;
+	std::string list = source;
+
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t end = list.find('|', pos);
+		if (end == std::string::npos)
+			end = list.size();
+		std::string entry = list.substr(pos, end - pos);
+		pos = end + 1;
+		if (entry.empty())
+			continue;
+
+		if (entry.find_first_of("*?") == std::string::npos) {
+			files.push_back(entry);
+			continue;
+		}
+
+		std::vector<std::string> matches;
+#ifdef _WIN32
+		size_t slash = entry.find_last_of("\\/");
+		std::string folder = slash == std::string::npos ? "" : entry.substr(0, slash + 1);
+		WIN32_FIND_DATA found;
+		HANDLE search = FindFirstFile(entry.c_str(), &found);
+		if (search == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("No file matches " + entry);
+		do {
+			if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+				matches.push_back(folder + found.cFileName);
+		} while (FindNextFile(search, &found));
+		FindClose(search);
+#else
+		glob_t found = {};
+		if (glob(entry.c_str(), 0, nullptr, &found) != 0) {
+			globfree(&found);
+			throw std::runtime_error("No file matches " + entry);
+		}
+		for (size_t i = 0; i < found.gl_pathc; i++) {
+			if (fileExists(found.gl_pathv[i]))
+				matches.push_back(found.gl_pathv[i]);
+		}
+		globfree(&found);
+#endif
+
+		std::sort(matches.begin(), matches.end());
+		files.insert(files.end(), matches.begin(), matches.end());
+	}
+
+	if (span && files.size() == 1)
+		addSpanFiles(files);
+
+	return files;
+}
+
+// AVX2 usable by cpu and os (ymm state saved)
+bool cpuHasAVX2() {
+	static const bool hasAVX2 = [] {
+#ifdef _WIN32
+		int info[4];
+		__cpuidex(info, 1, 0);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}();
+	return hasAVX2;
+}
+
+// UNC path or a mapped network drive (nfs or smb mount on linux)
+bool isNetworkPath(const std::string& path) {
+#ifndef _WIN32
+	struct statfs info;
+	if (statfs(path.c_str(), &info) != 0)
+		return false;
+	switch ((unsigned long)info.f_type) {
+		case 0x6969:     //nfs
+		case 0x517B:     //smb
+		case 0xFF534D42: //cifs
+		case 0xFE534D42: //smb2
+			return true;
+		default:
+			return false;
+	}
+#else
+	if (path.size() >= 2 && (path[0] == '\\' || path[0] == '/') && (path[1] == '\\' || path[1] == '/'))
+		return true;
+	if (path.size() < 2 || path[1] != ':')
+		return false;
+	std::string root = path.substr(0, 2) + "\\";
+	return GetDriveType(root.c_str()) == DRIVE_REMOTE;
+#endif
+}
+
+// Processor mask of a NUMA node (group and mask as windows wants it for SetThreadGroupAffinity)
+bool numaNodeAffinity(int node, GROUP_AFFINITY& affinity) {
+#ifndef _WIN32
+	if (node < 0)
+		return false;
+	std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+	std::string cpus;
+	if (!std::getline(cpulist, cpus))
+		return false;
+	return parseAffinity(cpus.c_str(), affinity);
+#else
+	ULONG highest = 0;
+	if (node < 0 || !GetNumaHighestNodeNumber(&highest) || (ULONG)node > highest)
+		return false;
+
+	memset(&affinity, 0, sizeof(affinity));
+	return GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) && affinity.Mask != 0;
+#endif
+}
+
+// Parses a cpu list like "0-7,16-23", cpu numbers count across processor groups (64 per group)
+bool parseAffinity(const char* cpus, GROUP_AFFINITY& affinity) {
+	memset(&affinity, 0, sizeof(affinity));
+	int group = -1;
+
+	std::string list = cpus;
+	size_t pos = 0;
+	while (pos < list.size()) {
+		size_t end = list.find(',', pos);
+		if (end == std::string::npos)
+			end = list.size();
+		std::string range = list.substr(pos, end - pos);
+		pos = end + 1;
+		if (range.empty())
+			continue;
+
+		int first = 0, last = 0;
+		size_t dash = range.find('-');
+		try {
+			first = std::stoi(range.substr(0, dash));
+			last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+		}
+		catch (std::exception&) {
+			return false;
+		}
+		if (first < 0 || last < first)
+			return false;
+
+		for (int cpu = first; cpu <= last; cpu++) {
+			if (group >= 0 && cpu / 64 != group)
+				return false; //a thread can only run in one processor group
+			group = cpu / 64;
+			affinity.Mask |= (KAFFINITY)1 << (cpu % 64);
+		}
+	}
+	affinity.Group = (unsigned short)(group < 0 ? 0 : group);
+	return affinity.Mask != 0;
+}
+
+int affinityCpuCount(const GROUP_AFFINITY& affinity) {
+	int count = 0;
+	for (KAFFINITY mask = affinity.Mask; mask; mask &= mask - 1)
+		count++;
+	return count;
+}
+
+bool pinThread(const GROUP_AFFINITY& affinity) {
+#ifdef _WIN32
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	for (int bit = 0; bit < 64; bit++) {
+		if (affinity.Mask & ((KAFFINITY)1 << bit))
+			CPU_SET(affinity.Group * 64 + bit, &cpus);
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#endif
+}
+
+// Full path of the plugin itself, the frame server is started from it
+std::string modulePath() {
+#ifdef _WIN32
+	char path[MAX_PATH] = { 0 };
+	GetModuleFileName((HINSTANCE)&__ImageBase, path, _countof(path));
+	return path;
+#else
+	Dl_info info = {};
+	if (!dladdr((void*)&modulePath, &info) || info.dli_fname == nullptr)
+		return "";
+	return info.dli_fname;
+#endif
+}
+
+// Folder of the plugin itself (with trailing separator), the sdk libraries are looked up relative to it
+std::string moduleDirectory() {
+	std::string module = modulePath();
+	if (module.empty())
+		return "./";
+#ifdef _WIN32
+	return module.substr(0, module.find_last_of("\\") + 1);
+#else
+	return module.substr(0, module.find_last_of('/') + 1);
+#endif
+}
+
+bool systemMemory(uint64_t& totalBytes, uint64_t& availableBytes) {
+#ifdef _WIN32
+	MEMORYSTATUSEX status = {};
+	status.dwLength = sizeof(status);
+	if (!GlobalMemoryStatusEx(&status))
+		return false;
+	totalBytes = status.ullTotalPhys;
+	availableBytes = status.ullAvailPhys;
+	return true;
+#else
+	//MemAvailable counts the page cache that can be dropped, like ullAvailPhys on windows
+	std::ifstream meminfo("/proc/meminfo");
+	std::string key;
+	uint64_t kb = 0;
+	while (meminfo >> key >> kb) {
+		if (key == "MemAvailable:") {
+			totalBytes = (uint64_t)sysconf(_SC_PHYS_PAGES) * (uint64_t)sysconf(_SC_PAGE_SIZE);
+			availableBytes = kb << 10;
+			return true;
+		}
+		meminfo.ignore(64, '\n');
+	}
+	return false;
+#endif
+}
+
+// Read only handle with a sequential hint for the file read ahead, nullptr on failure
+void* openSequentialRead(const std::string& path, uint64_t& size) {
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart <= 0) {
+		CloseHandle(handle);
+		return nullptr;
+	}
+	size = (uint64_t)fileSize.QuadPart;
+	return handle;
+#else
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return nullptr;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+		close(fd);
+		return nullptr;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	size = (uint64_t)info.st_size;
+	return (void*)(intptr_t)(fd + 1); //fd 0 would look like a failure
+#endif
+}
+
+bool readFileAt(void* file, uint64_t offset, void* buffer, uint32_t size, uint32_t& got) {
+	got = 0;
+#ifdef _WIN32
+	LARGE_INTEGER position = {};
+	position.QuadPart = (LONGLONG)offset;
+	DWORD read = 0;
+	bool ok = SetFilePointerEx(file, position, nullptr, FILE_BEGIN) && ReadFile(file, buffer, size, &read, nullptr);
+	got = read;
+	return ok;
+#else
+	ssize_t read = pread((int)(intptr_t)file - 1, buffer, size, (off_t)offset);
+	if (read < 0)
+		return false;
+	got = (uint32_t)read;
+	return true;
+#endif
+}
+
+void closeFile(void* file) {
+#ifdef _WIN32
+	CloseHandle(file);
+#else
+	close((int)(intptr_t)file - 1);
+#endif
+}
 //
 //
 //bool parse_y4m(std::vector<char>& header, VideoInfo& vi,
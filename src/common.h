@@ -13,22 +13,38 @@ for avisynth2.6x/Avisynth+.
 
 
 #include <cstring>
+#include <string>
 #include <vector>
 #include <stdexcept>
-#define WIN32_LEAN_AND_MEAN
-#define VC_EXTRALEAN
-#define NOMINMAX
-#define NOGDI
-#include <windows.h>
-#include <avisynth.h>
+#include "platform.h"
 
+#ifdef _MSC_VER
 #pragma warning(disable: 4996)
+#endif
 
 int gcd(int a, int b);
 void floatToFraction(float number, int& numerator, int& denominator);
 
-//
-typedef IScriptEnvironment ise_t;
+bool parseTimecode(const char* timecode, int fps, long long& frames);
+std::vector<std::string> expandSources(const char* source, bool span);
+
+bool cpuHasAVX2();
+bool isNetworkPath(const std::string& path);
+
+//thread placement helpers, all return false if the request cannot be satisfied
+bool numaNodeAffinity(int node, GROUP_AFFINITY& affinity);
+bool parseAffinity(const char* cpus, GROUP_AFFINITY& affinity);
+int affinityCpuCount(const GROUP_AFFINITY& affinity);
+bool pinThread(const GROUP_AFFINITY& affinity);
+
+//os services of the core, windows api or posix
+std::string modulePath();
+std::string moduleDirectory();
+bool systemMemory(uint64_t& totalBytes, uint64_t& availableBytes);
+void* openSequentialRead(const std::string& path, uint64_t& size);
+bool readFileAt(void* file, uint64_t offset, void* buffer, uint32_t size, uint32_t& got);
+void closeFile(void* file);
+
 //
 //constexpr unsigned MIN_WIDTH = 8;
 //constexpr unsigned MIN_HEIGHT = 8;
@@ -0,0 +1,745 @@
+#include "frameserver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include "common.h"
+#include <sddl.h>
+
+static const char* s_pipeName = "\\\\.\\pipe\\brawsource_server";
+static const int s_minSlots = 4;
+static const int s_idleSeconds = 600;          //idle sessions and finally the server itself go away after this
+static const int s_connectTimeoutMs = 10000;
+static const uint32_t s_maxMessageBytes = 1u << 30;
+
+enum MessageType : uint32_t { msgOpen = 1, msgFrame = 2, msgAudio = 3 };
+enum ReplyStatus : uint32_t { replyOk = 0, replyError = 1 };
+
+class MessageWriter {
+	/* flat encoding in host byte order, both ends are the same build of the plugin */
+public:
+	std::vector<uint8_t> data;
+
+	template<typename T> void field(const T& value) {
+		static_assert(std::is_arithmetic<T>::value, "plain values only");
+		const uint8_t* p = (const uint8_t*)&value;
+		data.insert(data.end(), p, p + sizeof(T));
+	}
+	void field(const std::string& value) {
+		field((uint32_t)value.size());
+		data.insert(data.end(), value.begin(), value.end());
+	}
+	void field(const std::vector<std::string>& values) {
+		field((uint32_t)values.size());
+		for (const std::string& value : values)
+			field(value);
+	}
+	void field(const std::vector<uint8_t>& values) {
+		field((uint32_t)values.size());
+		data.insert(data.end(), values.begin(), values.end());
+	}
+};
+
+class MessageReader {
+public:
+	MessageReader(const std::vector<uint8_t>& data) : data(data) {}
+
+	template<typename T> void field(T& value) {
+		static_assert(std::is_arithmetic<T>::value, "plain values only");
+		take(&value, sizeof(T));
+	}
+	void field(std::string& value) {
+		uint32_t size = 0;
+		field(size);
+		value.resize(size);
+		take(&value[0], size);
+	}
+	void field(std::vector<std::string>& values) {
+		uint32_t count = 0;
+		field(count);
+		values.clear();
+		for (uint32_t i = 0; i < count; i++) {
+			std::string value;
+			field(value);
+			values.push_back(value);
+		}
+	}
+	void field(std::vector<uint8_t>& values) {
+		uint32_t size = 0;
+		field(size);
+		values.resize(size);
+		take(values.data(), size);
+	}
+
+private:
+	void take(void* dst, size_t size) {
+		if (size > data.size() - pos)
+			throw std::runtime_error("broken message from the brawsource server");
+		if (size > 0)
+			memcpy(dst, data.data() + pos, size);
+		pos += size;
+	}
+
+	const std::vector<uint8_t>& data;
+	size_t pos = 0;
+};
+
+template<typename Message, typename Request>
+static void openRequestFields(Message& m, Request& r) {
+	/* the same list is written by the source and read by the server */
+	m.field(r.files);
+	m.field(r.bitmode);
+	m.field(r.options.threads);
+	m.field(r.options.numaNode);
+	m.field(r.options.affinity);
+	m.field(r.options.setIso);
+	m.field(r.options.setKelvin);
+	m.field(r.options.setTint);
+	m.field(r.options.setExposure);
+	m.field(r.options.iso);
+	m.field(r.options.kelvin);
+	m.field(r.options.tint);
+	m.field(r.options.exposure);
+	m.field(r.options.gamma);
+	m.field(r.options.gamut);
+	m.field(r.options.lut);
+	m.field(r.options.metadata);
+	m.field(r.options.qc);
+	m.field(r.options.readAheadMB);
+	m.field(r.options.compressedCacheMB);
+	m.field(r.options.scale);
+	m.field(r.options.crop);
+	m.field(r.options.cropLeft);
+	m.field(r.options.cropTop);
+	m.field(r.options.cropWidth);
+	m.field(r.options.cropHeight);
+	m.field(r.options.resizeWidth);
+	m.field(r.options.resizeHeight);
+	m.field(r.options.parallelRequests);
+	m.field(r.start);
+	m.field(r.end);
+	m.field(r.step);
+}
+
+template<typename Message, typename Info>
+static void clipInfoFields(Message& m, Info& info) {
+	m.field(info.width);
+	m.field(info.height);
+	m.field(info.framerateNum);
+	m.field(info.framerateDen);
+	m.field(info.rangeFrames);
+	m.field(info.rangeAudioSamples);
+	m.field(info.audioBitDepth);
+	m.field(info.channelCount);
+	m.field(info.sampleRate);
+	m.field(info.mappingName);
+	m.field(info.slotCount);
+	m.field(info.slotBytes);
+	m.field(info.numPlanes);
+	m.field(info.pitch);
+	m.field(info.planeBytes);
+}
+
+static bool writeAll(HANDLE pipe, const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*)data;
+	while (size > 0) {
+		DWORD written = 0;
+		if (!WriteFile(pipe, p, (DWORD)std::min<size_t>(size, 1 << 20), &written, nullptr) || written == 0)
+			return false;
+		p += written;
+		size -= written;
+	}
+	return true;
+}
+
+static bool readAll(HANDLE pipe, void* data, size_t size) {
+	uint8_t* p = (uint8_t*)data;
+	while (size > 0) {
+		DWORD got = 0;
+		if (!ReadFile(pipe, p, (DWORD)std::min<size_t>(size, 1 << 20), &got, nullptr) || got == 0)
+			return false;
+		p += got;
+		size -= got;
+	}
+	return true;
+}
+
+static bool sendMessage(HANDLE pipe, const std::vector<uint8_t>& message) {
+	uint32_t size = (uint32_t)message.size();
+	return writeAll(pipe, &size, sizeof(size)) && writeAll(pipe, message.data(), message.size());
+}
+
+static bool receiveMessage(HANDLE pipe, std::vector<uint8_t>& message) {
+	uint32_t size = 0;
+	if (!readAll(pipe, &size, sizeof(size)) || size > s_maxMessageBytes)
+		return false;
+	message.resize(size);
+	return readAll(pipe, message.data(), size);
+}
+
+static bool processUser(HANDLE process, std::string& sid) {
+	/* the user a process runs as, as string sid */
+	HANDLE token = nullptr;
+	if (!OpenProcessToken(process, TOKEN_QUERY, &token))
+		return false;
+	DWORD size = 0;
+	GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+	std::vector<uint8_t> user(size);
+	bool ok = size > 0 && GetTokenInformation(token, TokenUser, user.data(), size, &size);
+	CloseHandle(token);
+
+	char* text = nullptr;
+	if (!ok || !ConvertSidToStringSidA(((TOKEN_USER*)user.data())->User.Sid, &text))
+		return false;
+	sid = text;
+	LocalFree(text);
+	return true;
+}
+
+static std::string serverHost() {
+	/* rundll32 of the system in the bitness of this dll, the server runs in it */
+	char dir[MAX_PATH] = {};
+	UINT size = 0;
+#ifndef _WIN64
+	size = GetSystemWow64DirectoryA(dir, MAX_PATH); //none on 32 bit windows, there it is the system directory
+#endif
+	if (size == 0 || size >= MAX_PATH)
+		GetSystemDirectoryA(dir, MAX_PATH);
+	return std::string(dir) + "\\rundll32.exe";
+}
+
+#pragma region server
+
+class SlotPool {
+	/* frame slots of one session in a pagefile backed section the sources map read only.
+	   slot 0 is kept back for frames that did not get a slot of their own */
+public:
+	SlotPool(const std::string& name, int count, uint64_t slotBytes) : slotBytes(slotBytes) {
+		char buff[256] = {};
+		uint64_t total = slotBytes * (uint64_t)count;
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(total >> 32), (DWORD)total, name.c_str());
+		if (mapping != nullptr)
+			view = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		if (view == nullptr) {
+			if (mapping != nullptr)
+				CloseHandle(mapping);
+			sprintf(buff, "cannot create %d frame slots of %llu MB shared memory", count, (unsigned long long)(slotBytes >> 20));
+			throw std::runtime_error(buff);
+		}
+		for (int slot = count - 1; slot >= 1; slot--)
+			freeSlots.push_back(slot);
+	}
+
+	~SlotPool() {
+		UnmapViewOfFile(view);
+		CloseHandle(mapping);
+	}
+
+	int take() {
+		std::lock_guard<std::mutex> guard(lock);
+		if (freeSlots.empty())
+			return -1;
+		int slot = freeSlots.back();
+		freeSlots.pop_back();
+		return slot;
+	}
+
+	void give(int slot) {
+		std::lock_guard<std::mutex> guard(lock);
+		freeSlots.push_back(slot);
+	}
+
+	uint8_t* slot(int index) {
+		return view + slotBytes * (uint64_t)index;
+	}
+
+private:
+	uint64_t slotBytes;
+	HANDLE mapping = nullptr;
+	uint8_t* view = nullptr;
+	std::mutex lock;
+	std::vector<int> freeSlots;
+};
+
+class ServerOutputFrame : public OutputFrame {
+	/* a slot of the session, so the copy out of ProcessComplete lands where the source reads it.
+	   while all slots are held by cached frames, the frame lives on the heap and goes through slot 0 */
+public:
+	int slot = 0;
+
+	ServerOutputFrame(std::shared_ptr<SlotPool> pool, const ServerClipInfo& info) : pool(pool) {
+		slot = pool->take();
+		uint8_t* base = nullptr;
+		if (slot > 0) {
+			base = pool->slot(slot);
+		}
+		else {
+			heap.resize((size_t)info.slotBytes);
+			base = heap.data();
+		}
+		numPlanes = info.numPlanes;
+		for (int p = 0; p < numPlanes; p++) {
+			planes[p] = base + info.planeBytes * p;
+			pitches[p] = info.pitch;
+		}
+	}
+
+	~ServerOutputFrame() {
+		if (slot > 0)
+			pool->give(slot);
+	}
+
+	std::vector<uint8_t> heap;
+
+private:
+	std::shared_ptr<SlotPool> pool;
+};
+
+struct ServerSession {
+	std::vector<uint8_t> key;                   //the open request, equal requests get this session warm
+	ServerClipInfo info;
+	std::shared_ptr<SlotPool> pool;
+	std::shared_ptr<BRAWSDKProcessor> proc;
+	std::shared_ptr<DecodedFrame> delivered;    //its slot is read by the source until it asks for the next frame
+	std::chrono::steady_clock::time_point idleSince;
+
+	OutputAllocator allocator() {
+		return [this]() {
+			return std::make_shared<ServerOutputFrame>(pool, info);
+		};
+	}
+
+	int deliver(int frameNum) {
+		delivered.reset();
+		delivered = proc->fetchFrame(frameNum, allocator());
+
+		ServerOutputFrame* frame = static_cast<ServerOutputFrame*>(delivered->output.get());
+		if (frame->slot > 0)
+			return frame->slot;
+
+		memcpy(pool->slot(0), frame->heap.data(), frame->heap.size());
+		return 0;
+	}
+};
+
+static long long framePosition(const std::string& pos, BRAWSDKProcessor& proc, long long def) {
+	//frame number or timecode like the avisynth arguments
+	if (pos.empty())
+		return def;
+	if (pos.find(':') == std::string::npos)
+		return std::stoll(pos);
+	return proc.frameForTimecode(pos.c_str());
+}
+
+static std::unique_ptr<ServerSession> openSession(const ServerOpenRequest& request, const std::vector<uint8_t>& key) {
+	static std::atomic<unsigned> sessionCounter(0);
+
+	std::unique_ptr<ServerSession> session(new ServerSession());
+	session->key = key;
+	session->proc = std::make_shared<BRAWSDKProcessor>();
+	BRAWSDKProcessor& proc = *session->proc;
+	proc.openFile(request.files, request.bitmode, request.options);
+
+	long long first = framePosition(request.start, proc, 0);
+	long long last = framePosition(request.end, proc, (long long)proc.frameCount - 1);
+	validate(first < 0 || last < 0, "start/end is before the first frame of the clip");
+	proc.setRange(first, last, request.step);
+
+	ServerClipInfo& info = session->info;
+	info.width = proc.width;
+	info.height = proc.height;
+	info.framerateNum = proc.framerate_num;
+	info.framerateDen = proc.framerate_den;
+	info.rangeFrames = proc.rangeFrames;
+	info.rangeAudioSamples = proc.rangeAudioSamples;
+	info.audioBitDepth = proc.audioBitDepth;
+	info.channelCount = proc.channelCount;
+	info.sampleRate = proc.sampleRate;
+
+	//bgra for 8 bit, planar R,G,B otherwise, the layout the copy stage writes for avisynth
+	int bytes = request.bitmode == 8 ? 4 : request.bitmode / 8;
+	info.numPlanes = request.bitmode == 8 ? 1 : 3;
+	info.pitch = (info.width * bytes + 63) & ~63;
+	info.planeBytes = (uint64_t)info.pitch * info.height;
+	info.slotBytes = info.planeBytes * info.numPlanes;
+
+	//a slot for every frame the processor may hold, so decodes land in slots and not on the heap, plus slot 0
+	//and the delivered frame. slots are committed memory, at most a quarter of what is free
+	uint64_t total = 0, available = 0;
+	systemMemory(total, available);
+	uint64_t wanted = (uint64_t)proc.maxHeldFrames() + 2;
+	info.slotCount = (int)std::max<uint64_t>(s_minSlots, std::min<uint64_t>(wanted, available / 4 / info.slotBytes));
+	info.mappingName = "Local\\brawsource_" + std::to_string(GetCurrentProcessId()) + "_" + std::to_string(++sessionCounter);
+	session->pool = std::make_shared<SlotPool>(info.mappingName, info.slotCount, info.slotBytes);
+
+	proc.warmUp(session->allocator(), request.step > 1 ? proc.rangeFrames : 1);
+	return session;
+}
+
+static std::mutex s_serverLock;
+static std::list<std::unique_ptr<ServerSession>> s_idleSessions;
+static int s_clients = 0;
+static std::chrono::steady_clock::time_point s_lastActivity;
+static bool s_stopping = false; //the server exits, connections are not accepted anymore
+
+static std::unique_ptr<ServerSession> takeIdleSession(const std::vector<uint8_t>& key) {
+	std::lock_guard<std::mutex> guard(s_serverLock);
+	for (auto it = s_idleSessions.begin(); it != s_idleSessions.end(); ++it) {
+		if ((*it)->key == key) {
+			std::unique_ptr<ServerSession> session = std::move(*it);
+			s_idleSessions.erase(it);
+			return session;
+		}
+	}
+	return nullptr;
+}
+
+static void releaseSession(std::unique_ptr<ServerSession> session) {
+	//decoder and cached frames stay warm for the next source with the same request
+	session->delivered.reset();
+	session->idleSince = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> guard(s_serverLock);
+	s_idleSessions.push_back(std::move(session));
+}
+
+static void serveClient(HANDLE pipe) {
+	/* one thread per connected source, requests are answered in order */
+	std::unique_ptr<ServerSession> session;
+	std::vector<uint8_t> message;
+
+	while (receiveMessage(pipe, message)) {
+		MessageWriter reply;
+		try {
+			MessageReader reader(message);
+			uint32_t type = 0;
+			reader.field(type);
+
+			if (type == msgOpen) {
+				ServerOpenRequest request;
+				openRequestFields(reader, request);
+				if (session)
+					releaseSession(std::move(session));
+				session = takeIdleSession(message);
+				if (!session)
+					session = openSession(request, message);
+				reply.field((uint32_t)replyOk);
+				clipInfoFields(reply, session->info);
+			}
+			else if (type == msgFrame) {
+				validate(!session, "no clip opened");
+				int32_t frameNum = 0;
+				reader.field(frameNum);
+				int32_t slot = session->deliver(frameNum);
+				reply.field((uint32_t)replyOk);
+				reply.field(slot);
+			}
+			else if (type == msgAudio) {
+				validate(!session, "no clip opened");
+				int64_t start = 0, count = 0;
+				reader.field(start);
+				reader.field(count);
+				uint64_t bytes = (uint64_t)count * session->info.channelCount * (session->info.audioBitDepth / 8);
+				validate(count < 0 || bytes > s_maxMessageBytes / 2, "audio request too large");
+				std::vector<uint8_t> samples((size_t)bytes);
+				session->proc->getAudioSamples(samples.data(), start, count);
+				reply.field((uint32_t)replyOk);
+				reply.field(samples);
+			}
+			else {
+				throw std::runtime_error("unknown request");
+			}
+		}
+		catch (std::exception& e) {
+			reply.data.clear();
+			reply.field((uint32_t)replyError);
+			reply.field(std::string(e.what()));
+		}
+		if (!sendMessage(pipe, reply.data))
+			break;
+	}
+
+	if (session)
+		releaseSession(std::move(session));
+	DisconnectNamedPipe(pipe);
+	CloseHandle(pipe);
+}
+
+static void expireSessions() {
+	/* drops sessions nobody asked for within s_idleSeconds, the process ends once it has nothing left */
+	for (;;) {
+		std::this_thread::sleep_for(std::chrono::seconds(5));
+		auto now = std::chrono::steady_clock::now();
+		auto timeout = std::chrono::seconds(s_idleSeconds);
+
+		std::list<std::unique_ptr<ServerSession>> expired;
+		bool finished = false;
+		{
+			std::lock_guard<std::mutex> guard(s_serverLock);
+			for (auto it = s_idleSessions.begin(); it != s_idleSessions.end();) {
+				if (now - (*it)->idleSince > timeout) {
+					expired.push_back(std::move(*it));
+					it = s_idleSessions.erase(it);
+				}
+				else {
+					++it;
+				}
+			}
+			finished = s_clients == 0 && s_idleSessions.empty() && now - s_lastActivity > timeout;
+		}
+		expired.clear(); //waits for their jobs, outside of the lock
+
+		//decided under the lock, a client that connected meanwhile is either counted already or turned away
+		if (finished) {
+			std::lock_guard<std::mutex> guard(s_serverLock);
+			if (s_clients == 0 && s_idleSessions.empty() && std::chrono::steady_clock::now() - s_lastActivity > timeout) {
+				s_stopping = true;
+				ExitProcess(0);
+			}
+		}
+	}
+}
+
+static PSECURITY_DESCRIPTOR currentUserOnly() {
+	/* the pipe grants access to the user who runs the server and nobody else */
+	std::string sid;
+	if (!processUser(GetCurrentProcess(), sid))
+		return nullptr;
+	std::string sddl = "D:P(A;;GA;;;" + sid + ")";
+	PSECURITY_DESCRIPTOR descriptor = nullptr;
+	if (!ConvertStringSecurityDescriptorToSecurityDescriptorA(sddl.c_str(), SDDL_REVISION_1, &descriptor, nullptr))
+		return nullptr;
+	return descriptor;
+}
+
+void runFrameServer() {
+	//local connections of the same user only, the sessions hand out the decoded frames of their files
+	SECURITY_ATTRIBUTES security = {};
+	security.nLength = sizeof(security);
+	security.lpSecurityDescriptor = currentUserOnly();
+	if (security.lpSecurityDescriptor == nullptr)
+		return;
+
+	bool first = true;
+	for (;;) {
+		HANDLE pipe = CreateNamedPipeA(s_pipeName, PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+			PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, PIPE_UNLIMITED_INSTANCES,
+			1 << 16, 1 << 16, 0, &security);
+		if (pipe == INVALID_HANDLE_VALUE) {
+			if (first) {
+				LocalFree(security.lpSecurityDescriptor);
+				return; //another server has the pipe
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			continue;
+		}
+		if (first) {
+			s_lastActivity = std::chrono::steady_clock::now();
+			std::thread(expireSessions).detach();
+			first = false;
+		}
+
+		if (!ConnectNamedPipe(pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED) {
+			CloseHandle(pipe);
+			continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(s_serverLock);
+			if (s_stopping) {
+				CloseHandle(pipe); //the client starts a new server
+				continue;
+			}
+			s_clients++;
+			s_lastActivity = std::chrono::steady_clock::now();
+		}
+		std::thread([pipe] {
+			serveClient(pipe);
+			std::lock_guard<std::mutex> guard(s_serverLock);
+			s_clients--;
+			s_lastActivity = std::chrono::steady_clock::now();
+		}).detach();
+	}
+}
+
+#pragma endregion server
+
+#pragma region client
+
+static void checkReply(MessageReader& reader) {
+	uint32_t status = replyError;
+	reader.field(status);
+	if (status == replyOk)
+		return;
+	std::string error;
+	reader.field(error);
+	throw std::runtime_error(error);
+}
+
+static void startServer() {
+	/* the server runs from this dll in its own process, detached so it outlives the avisynth process */
+	std::string command = "\"" + serverHost() + "\" \"" + modulePath() + "\",BRawServer";
+	std::vector<char> line(command.begin(), command.end());
+	line.push_back(0);
+
+	STARTUPINFOA startup = {};
+	startup.cb = sizeof(startup);
+	PROCESS_INFORMATION process = {};
+	if (!CreateProcessA(nullptr, line.data(), nullptr, nullptr, FALSE, DETACHED_PROCESS | CREATE_NEW_PROCESS_GROUP, nullptr, nullptr, &startup, &process))
+		throw std::runtime_error("cannot start the brawsource server");
+	CloseHandle(process.hThread);
+	CloseHandle(process.hProcess);
+}
+
+static bool trustedServer(HANDLE pipe) {
+	/* anybody can create the pipe before the server does, the frames only come from a server of this plugin
+	   (rundll32 of the system) that runs as the same user as we do */
+	ULONG pid = 0;
+	if (!GetNamedPipeServerProcessId(pipe, &pid))
+		return false;
+	HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+	if (process == nullptr)
+		return false;
+
+	char image[MAX_PATH] = {};
+	DWORD size = MAX_PATH;
+	std::string serverUser, ourUser;
+	bool trusted = QueryFullProcessImageNameA(process, 0, image, &size) && _stricmp(image, serverHost().c_str()) == 0
+		&& processUser(process, serverUser) && processUser(GetCurrentProcess(), ourUser) && serverUser == ourUser;
+	CloseHandle(process);
+	return trusted;
+}
+
+void FrameClient::connect() {
+	bool started = false;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(s_connectTimeoutMs);
+	for (;;) {
+		HANDLE handle = CreateFileA(s_pipeName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+		if (handle != INVALID_HANDLE_VALUE) {
+			if (!trustedServer(handle)) {
+				CloseHandle(handle);
+				throw std::runtime_error("the brawsource server pipe belongs to another program or user");
+			}
+			pipe = handle;
+			return;
+		}
+		DWORD error = GetLastError();
+		if (std::chrono::steady_clock::now() > deadline)
+			throw std::runtime_error("cannot connect to the brawsource server");
+
+		if (error == ERROR_PIPE_BUSY) {
+			WaitNamedPipeA(s_pipeName, 1000);
+			continue;
+		}
+		if (!started) {
+			startServer();
+			started = true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+}
+
+FrameClient::FrameClient(const ServerOpenRequest& openRequest) {
+	/* the handles are closed here if opening fails, the destructor does not run then */
+	char buff[256] = {};
+
+	MessageWriter message;
+	message.field((uint32_t)msgOpen);
+	openRequestFields(message, openRequest);
+
+	try {
+		//a server that ends for being idle may take the connection and exit, then a new one is started
+		std::vector<uint8_t> reply;
+		for (int attempt = 0;; attempt++) {
+			connect();
+			if (sendMessage(pipe, message.data) && receiveMessage(pipe, reply))
+				break;
+			CloseHandle(pipe);
+			pipe = nullptr;
+			if (attempt > 0)
+				throw std::runtime_error("lost the connection to the brawsource server");
+		}
+		MessageReader reader(reply);
+		checkReply(reader);
+		clipInfoFields(reader, info);
+
+		mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, info.mappingName.c_str());
+		if (mapping != nullptr)
+			view = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (view == nullptr) {
+			sprintf(buff, "cannot map the frames of the brawsource server (%.64s)", info.mappingName.c_str());
+			throw std::runtime_error(buff);
+		}
+	}
+	catch (...) {
+		close();
+		throw;
+	}
+}
+
+FrameClient::~FrameClient() {
+	close(); //the server keeps the session warm for the next source
+}
+
+void FrameClient::close() {
+	if (view != nullptr)
+		UnmapViewOfFile(view);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (pipe != nullptr)
+		CloseHandle(pipe);
+	view = nullptr;
+	mapping = nullptr;
+	pipe = nullptr;
+}
+
+void FrameClient::request(const std::vector<uint8_t>& message, std::vector<uint8_t>& reply) {
+	if (!sendMessage(pipe, message) || !receiveMessage(pipe, reply))
+		throw std::runtime_error("lost the connection to the brawsource server");
+}
+
+void FrameClient::fetchFrame(int frameNum, const std::function<void(const uint8_t* const* planes, int pitch)>& copy) {
+	std::lock_guard<std::mutex> guard(lock);
+
+	MessageWriter message;
+	message.field((uint32_t)msgFrame);
+	message.field((int32_t)frameNum);
+
+	std::vector<uint8_t> reply;
+	request(message.data, reply);
+	MessageReader reader(reply);
+	checkReply(reader);
+	int32_t slot = 0;
+	reader.field(slot);
+	validate(slot < 0 || slot >= info.slotCount, "broken message from the brawsource server");
+
+	//the slot stays untouched by the server until our next request
+	const uint8_t* planes[3] = {};
+	for (int p = 0; p < info.numPlanes; p++)
+		planes[p] = view + info.slotBytes * slot + info.planeBytes * p;
+	copy(planes, info.pitch);
+}
+
+void FrameClient::readAudio(void* buf, int64_t start, int64_t count) {
+	std::lock_guard<std::mutex> guard(lock);
+
+	MessageWriter message;
+	message.field((uint32_t)msgAudio);
+	message.field(start);
+	message.field(count);
+
+	std::vector<uint8_t> reply;
+	request(message.data, reply);
+	MessageReader reader(reply);
+	checkReply(reader);
+	std::vector<uint8_t> samples;
+	reader.field(samples);
+	validate(samples.size() != (size_t)count * info.channelCount * (info.audioBitDepth / 8), "broken message from the brawsource server");
+	memcpy(buf, samples.data(), samples.size());
+}
+
+#pragma endregion client
@@ -0,0 +1,74 @@
+
+#ifndef BMDFRAMESERVERHEADER_H
+#define BMDFRAMESERVERHEADER_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bmd.h"
+
+/* optional daemon mode (server=true): one long lived process owns the sdk factory, decoders and frame caches,
+   sources in the avisynth processes connect over a named pipe. the copy out of ProcessComplete writes into slots
+   of a shared memory section, so a frame crosses the process boundary without an extra copy in the server.
+   the server is hosted by the plugin dll itself (rundll32 BRawSource.dll,BRawServer) and started on first use */
+
+struct ServerOpenRequest {
+	/* everything that decides what a source decodes, sessions with the same request are reused warm */
+	std::vector<std::string> files;
+	int bitmode = 8;
+	ProcessorOptions options;
+	std::string start;             //frame number or timecode, empty = first frame
+	std::string end;               //frame number or timecode, empty = last frame
+	int step = 1;
+};
+
+struct ServerClipInfo {
+	int width = 0;
+	int height = 0;
+	int framerateNum = 0;
+	int framerateDen = 0;
+	unsigned long long rangeFrames = 0;
+	int64_t rangeAudioSamples = 0;
+	uint32_t audioBitDepth = 0;
+	uint32_t channelCount = 0;
+	uint32_t sampleRate = 0;
+
+	//frame slots in the shared memory section, planes of a slot follow each other
+	std::string mappingName;
+	int slotCount = 0;
+	uint64_t slotBytes = 0;
+	int numPlanes = 0;
+	int pitch = 0;                 //of every plane, rows are top down
+	uint64_t planeBytes = 0;
+};
+
+class FrameClient {
+	/* the source side of a server session, calls are serialized, the frame is copied out of its slot
+	   before the next request lets the server reuse it */
+public:
+	FrameClient(const ServerOpenRequest& request);
+	~FrameClient();
+
+	ServerClipInfo info;
+
+	//calls copy(slot planes, pitch) while the slot is valid
+	void fetchFrame(int frameNum, const std::function<void(const uint8_t* const* planes, int pitch)>& copy);
+	void readAudio(void* buf, int64_t start, int64_t count);
+
+private:
+	void connect();
+	void close();
+	void request(const std::vector<uint8_t>& message, std::vector<uint8_t>& reply);
+
+	std::mutex lock;
+	void* pipe = nullptr;
+	void* mapping = nullptr;
+	const uint8_t* view = nullptr;
+};
+
+//runs the server until it was idle for a while, returns at once if a server is running already
+void runFrameServer();
+
+#endif
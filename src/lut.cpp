@@ -0,0 +1,284 @@
+
+#include "lut.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <immintrin.h>
+#include "common.h"
+
+static const int s_chunk = 256; //pixels converted per step, keeps the temporaries in L1
+
+std::unique_ptr<Lut3D> Lut3D::fromCubeFile(const std::string& path) {
+	std::ifstream file(path);
+	if (!file.is_open())
+		throw std::runtime_error("Cannot open LUT file " + path);
+
+	std::unique_ptr<Lut3D> lut(new Lut3D());
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#')
+			continue;
+
+		std::istringstream fields(line.substr(first));
+		if (isalpha((unsigned char)line[first])) {
+			std::string keyword;
+			fields >> keyword;
+			if (keyword == "LUT_3D_SIZE") {
+				fields >> lut->size;
+				if (lut->size < 2 || lut->size > 256)
+					throw std::runtime_error("LUT_3D_SIZE out of range in " + path);
+				lut->table.reserve((size_t)lut->size * lut->size * lut->size * 3);
+			}
+			else if (keyword == "DOMAIN_MIN") {
+				fields >> lut->domainMin[0] >> lut->domainMin[1] >> lut->domainMin[2];
+			}
+			else if (keyword == "DOMAIN_MAX") {
+				fields >> lut->domainMax[0] >> lut->domainMax[1] >> lut->domainMax[2];
+			}
+			else if (keyword == "LUT_1D_SIZE") {
+				throw std::runtime_error("1D LUTs are not supported, " + path + " must be a 3D LUT");
+			}
+			continue; //TITLE and unknown keywords
+		}
+
+		float r, g, b;
+		if (!(fields >> r >> g >> b))
+			throw std::runtime_error("Cannot parse LUT line \"" + line + "\" in " + path);
+		lut->table.push_back(r);
+		lut->table.push_back(g);
+		lut->table.push_back(b);
+	}
+
+	if (lut->size == 0 || lut->table.size() != (size_t)lut->size * lut->size * lut->size * 3)
+		throw std::runtime_error("LUT_3D_SIZE does not match the number of entries in " + path);
+	for (int c = 0; c < 3; c++) {
+		if (!(lut->domainMax[c] > lut->domainMin[c]))
+			throw std::runtime_error("DOMAIN_MAX must be greater than DOMAIN_MIN in " + path);
+	}
+
+	lut->useAVX2 = cpuHasAVX2();
+	return lut;
+}
+
+std::unique_ptr<Lut3D> Lut3D::fromTable(const float* data, int size, int channels) {
+	std::unique_ptr<Lut3D> lut(new Lut3D());
+	lut->size = size;
+	size_t entries = (size_t)size * size * size;
+	lut->table.resize(entries * 3);
+	for (size_t i = 0; i < entries; i++) {
+		lut->table[i * 3 + 0] = data[i * channels + 0];
+		lut->table[i * 3 + 1] = data[i * channels + 1];
+		lut->table[i * 3 + 2] = data[i * channels + 2];
+	}
+	lut->useAVX2 = cpuHasAVX2();
+	return lut;
+}
+
+void Lut3D::prepareShaper(int bits) {
+	/* code value -> coordinate in lut cells, domain and clamping done once here instead of per pixel */
+	shaperBits = bits;
+	size_t codes = (size_t)1 << bits;
+	float maxCode = (float)(codes - 1);
+	shaper.resize(codes * 3);
+	for (int c = 0; c < 3; c++) {
+		for (size_t code = 0; code < codes; code++) {
+			float v = (code / maxCode - domainMin[c]) / (domainMax[c] - domainMin[c]);
+			shaper[c * codes + code] = std::min(std::max(v, 0.0f), 1.0f) * (size - 1);
+		}
+	}
+}
+
+void Lut3D::interpolate(const float* r, const float* g, const float* b, float* outR, float* outG, float* outB, int count) {
+	int done = 0;
+	if (useAVX2) {
+		done = count & ~7;
+		interpolateAVX2(r, g, b, outR, outG, outB, done);
+	}
+	if (done < count)
+		interpolateScalar(r + done, g + done, b + done, outR + done, outG + done, outB + done, count - done);
+}
+
+void Lut3D::interpolateScalar(const float* r, const float* g, const float* b, float* outR, float* outG, float* outB, int count) {
+	/* coordinates are in lut cells [0, size - 1]. the cube cell is split in 6 tetrahedra along the
+	   diagonal, the one containing the point is found by ordering the fractions */
+	const int dr = 3, dg = 3 * size, db = 3 * size * size;
+	const float* t = table.data();
+
+	for (int i = 0; i < count; i++) {
+		int ir = std::min((int)r[i], size - 2);
+		int ig = std::min((int)g[i], size - 2);
+		int ib = std::min((int)b[i], size - 2);
+		float fr = r[i] - ir, fg = g[i] - ig, fb = b[i] - ib;
+
+		int offMax, offMin;
+		float fMax, fMin;
+		if (fr >= fg && fr >= fb) { offMax = dr; fMax = fr; }
+		else if (fg >= fb) { offMax = dg; fMax = fg; }
+		else { offMax = db; fMax = fb; }
+		if (fb <= fg && fb <= fr) { offMin = db; fMin = fb; }
+		else if (fg <= fr) { offMin = dg; fMin = fg; }
+		else { offMin = dr; fMin = fr; }
+		float fMid = fr + fg + fb - fMax - fMin;
+		int offMid = dr + dg + db - offMax - offMin;
+
+		const float* c000 = t + ib * db + ig * dg + ir * dr;
+		const float* c1 = c000 + offMax;
+		const float* c2 = c1 + offMid;
+		const float* c111 = c000 + dr + dg + db;
+
+		float w0 = 1 - fMax, w1 = fMax - fMid, w2 = fMid - fMin, w3 = fMin;
+		outR[i] = w0 * c000[0] + w1 * c1[0] + w2 * c2[0] + w3 * c111[0];
+		outG[i] = w0 * c000[1] + w1 * c1[1] + w2 * c2[1] + w3 * c111[1];
+		outB[i] = w0 * c000[2] + w1 * c1[2] + w2 * c2[2] + w3 * c111[2];
+	}
+}
+
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+void Lut3D::interpolateAVX2(const float* r, const float* g, const float* b, float* outR, float* outG, float* outB, int count) {
+	/* same as interpolateScalar for 8 pixels, the tetrahedron is picked with compare masks and the
+	   4 corners are fetched with gathers */
+	const __m256i dr = _mm256_set1_epi32(3);
+	const __m256i dg = _mm256_set1_epi32(3 * size);
+	const __m256i db = _mm256_set1_epi32(3 * size * size);
+	const __m256i dAll = _mm256_set1_epi32(3 + 3 * size + 3 * size * size);
+	const __m256i maxCell = _mm256_set1_epi32(size - 2);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const float* t = table.data();
+
+	for (int i = 0; i < count; i += 8) {
+		__m256 vr = _mm256_loadu_ps(r + i);
+		__m256 vg = _mm256_loadu_ps(g + i);
+		__m256 vb = _mm256_loadu_ps(b + i);
+
+		__m256i ir = _mm256_min_epi32(_mm256_cvttps_epi32(vr), maxCell);
+		__m256i ig = _mm256_min_epi32(_mm256_cvttps_epi32(vg), maxCell);
+		__m256i ib = _mm256_min_epi32(_mm256_cvttps_epi32(vb), maxCell);
+		__m256 fr = _mm256_sub_ps(vr, _mm256_cvtepi32_ps(ir));
+		__m256 fg = _mm256_sub_ps(vg, _mm256_cvtepi32_ps(ig));
+		__m256 fb = _mm256_sub_ps(vb, _mm256_cvtepi32_ps(ib));
+
+		__m256 rGEg = _mm256_cmp_ps(fr, fg, _CMP_GE_OQ);
+		__m256 rGEb = _mm256_cmp_ps(fr, fb, _CMP_GE_OQ);
+		__m256 gGEb = _mm256_cmp_ps(fg, fb, _CMP_GE_OQ);
+
+		//largest fraction: r if r>=g && r>=b, else g if g>=b, else b
+		__m256 maxIsR = _mm256_and_ps(rGEg, rGEb);
+		__m256 fMax = _mm256_blendv_ps(_mm256_blendv_ps(fb, fg, gGEb), fr, maxIsR);
+		__m256i offMax = _mm256_castps_si256(_mm256_blendv_ps(
+			_mm256_blendv_ps(_mm256_castsi256_ps(db), _mm256_castsi256_ps(dg), gGEb), _mm256_castsi256_ps(dr), maxIsR));
+
+		//smallest fraction: b if b<=g && b<=r, else g if g<=r, else r
+		__m256 minIsB = _mm256_and_ps(gGEb, rGEb);
+		__m256 fMin = _mm256_blendv_ps(_mm256_blendv_ps(fr, fg, rGEg), fb, minIsB);
+		__m256i offMin = _mm256_castps_si256(_mm256_blendv_ps(
+			_mm256_blendv_ps(_mm256_castsi256_ps(dr), _mm256_castsi256_ps(dg), rGEg), _mm256_castsi256_ps(db), minIsB));
+
+		__m256 fMid = _mm256_sub_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(fr, fg), fb), fMax), fMin);
+		__m256i offMid = _mm256_sub_epi32(_mm256_sub_epi32(dAll, offMax), offMin);
+
+		__m256i base = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(ir, dr), _mm256_mullo_epi32(ig, dg)), _mm256_mullo_epi32(ib, db));
+		__m256i i1 = _mm256_add_epi32(base, offMax);
+		__m256i i2 = _mm256_add_epi32(i1, offMid);
+		__m256i i3 = _mm256_add_epi32(base, dAll);
+
+		__m256 w0 = _mm256_sub_ps(one, fMax);
+		__m256 w1 = _mm256_sub_ps(fMax, fMid);
+		__m256 w2 = _mm256_sub_ps(fMid, fMin);
+		__m256 w3 = fMin;
+
+		float* out[3] = { outR, outG, outB };
+		for (int c = 0; c < 3; c++) {
+			const __m256i cc = _mm256_set1_epi32(c);
+			__m256 v = _mm256_mul_ps(w0, _mm256_i32gather_ps(t, _mm256_add_epi32(base, cc), 4));
+			v = _mm256_add_ps(v, _mm256_mul_ps(w1, _mm256_i32gather_ps(t, _mm256_add_epi32(i1, cc), 4)));
+			v = _mm256_add_ps(v, _mm256_mul_ps(w2, _mm256_i32gather_ps(t, _mm256_add_epi32(i2, cc), 4)));
+			v = _mm256_add_ps(v, _mm256_mul_ps(w3, _mm256_i32gather_ps(t, _mm256_add_epi32(i3, cc), 4)));
+			_mm256_storeu_ps(out[c] + i, v);
+		}
+	}
+}
+
+static inline uint8_t toU8(float v) {
+	v = v * 255.0f + 0.5f;
+	return (uint8_t)(v < 0 ? 0 : (v > 255.0f ? 255.0f : v));
+}
+
+static inline uint16_t toU16(float v) {
+	v = v * 65535.0f + 0.5f;
+	return (uint16_t)(v < 0 ? 0 : (v > 65535.0f ? 65535.0f : v));
+}
+
+void Lut3D::applyBGRA8(const uint8_t* src, uint8_t* dst, int count) {
+	alignas(32) float in[3][s_chunk];
+	alignas(32) float out[3][s_chunk];
+	const float* shR = shaper.data();
+	const float* shG = shR + 256;
+	const float* shB = shG + 256;
+
+	for (int x = 0; x < count; x += s_chunk) {
+		int n = std::min(s_chunk, count - x);
+		const uint8_t* s = src + x * 4;
+		for (int i = 0; i < n; i++) {
+			in[0][i] = shR[s[i * 4 + 2]];
+			in[1][i] = shG[s[i * 4 + 1]];
+			in[2][i] = shB[s[i * 4 + 0]];
+		}
+		interpolate(in[0], in[1], in[2], out[0], out[1], out[2], n);
+		uint8_t* d = dst + x * 4;
+		for (int i = 0; i < n; i++) {
+			d[i * 4 + 0] = toU8(out[2][i]);
+			d[i * 4 + 1] = toU8(out[1][i]);
+			d[i * 4 + 2] = toU8(out[0][i]);
+			d[i * 4 + 3] = s[i * 4 + 3];
+		}
+	}
+}
+
+void Lut3D::applyPlanarU16(const uint16_t* const src[3], uint16_t* const dst[3], int count) {
+	alignas(32) float in[3][s_chunk];
+	alignas(32) float out[3][s_chunk];
+
+	for (int x = 0; x < count; x += s_chunk) {
+		int n = std::min(s_chunk, count - x);
+		for (int c = 0; c < 3; c++) {
+			const float* sh = shaper.data() + ((size_t)c << 16);
+			const uint16_t* s = src[c] + x;
+			for (int i = 0; i < n; i++)
+				in[c][i] = sh[s[i]];
+		}
+		interpolate(in[0], in[1], in[2], out[0], out[1], out[2], n);
+		for (int c = 0; c < 3; c++) {
+			uint16_t* d = dst[c] + x;
+			for (int i = 0; i < n; i++)
+				d[i] = toU16(out[c][i]);
+		}
+	}
+}
+
+void Lut3D::applyPlanarF32(const float* const src[3], float* const dst[3], int count) {
+	/* float has no shaper table, domain scaling and clamping is done per pixel */
+	alignas(32) float in[3][s_chunk];
+	float scale[3], offset[3];
+	for (int c = 0; c < 3; c++) {
+		scale[c] = (size - 1) / (domainMax[c] - domainMin[c]);
+		offset[c] = -domainMin[c] * scale[c];
+	}
+	const float maxCoord = (float)(size - 1);
+
+	for (int x = 0; x < count; x += s_chunk) {
+		int n = std::min(s_chunk, count - x);
+		for (int c = 0; c < 3; c++) {
+			const float* s = src[c] + x;
+			for (int i = 0; i < n; i++) {
+				float v = s[i] * scale[c] + offset[c];
+				in[c][i] = !(v > 0) ? 0 : (v > maxCoord ? maxCoord : v); //also maps NaN to 0
+			}
+		}
+		interpolate(in[0], in[1], in[2], dst[0] + x, dst[1] + x, dst[2] + x, n);
+	}
+}
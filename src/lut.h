@@ -0,0 +1,42 @@
+
+#ifndef BMDLUTHEADER_H
+#define BMDLUTHEADER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Lut3D {
+	/* 3D LUT applied inside the copy out of ProcessComplete, one pass over the frame instead of
+	   a separate filter. tetrahedral interpolation, 8 pixels at a time with AVX2 */
+public:
+
+	static std::unique_ptr<Lut3D> fromCubeFile(const std::string& path);
+	//rgb or rgba float triplets (channels = 3 or 4), red changing fastest like in .cube files
+	static std::unique_ptr<Lut3D> fromTable(const float* data, int size, int channels);
+
+	//integer inputs go through a precomputed 1D shaper (code value -> lut coordinate)
+	void prepareShaper(int bits);
+
+	void applyBGRA8(const uint8_t* src, uint8_t* dst, int count);
+	void applyPlanarU16(const uint16_t* const src[3], uint16_t* const dst[3], int count);
+	void applyPlanarF32(const float* const src[3], float* const dst[3], int count);
+
+	int size = 0;
+
+private:
+
+	void interpolate(const float* r, const float* g, const float* b, float* outR, float* outG, float* outB, int count);
+	void interpolateScalar(const float* r, const float* g, const float* b, float* outR, float* outG, float* outB, int count);
+	void interpolateAVX2(const float* r, const float* g, const float* b, float* outR, float* outG, float* outB, int count);
+
+	std::vector<float> table;      //rgb triplets, red changes fastest
+	float domainMin[3] = { 0, 0, 0 };
+	float domainMax[3] = { 1, 1, 1 };
+	std::vector<float> shaper;     //3 * 2^bits lut coordinates
+	int shaperBits = 0;
+	bool useAVX2 = false;
+};
+
+#endif
@@ -0,0 +1,39 @@
+
+#ifndef BMDPLATFORMHEADER_H
+#define BMDPLATFORMHEADER_H
+
+/* what differs between the windows build (avisynth) and the linux build (vapoursynth) on the os side,
+   the os helpers themselves are in common.cpp. the sdk differences are in bmd.h */
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#define VC_EXTRALEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+
+#else
+
+#include <pthread.h>
+#include <sched.h>
+
+#ifndef MAX_PATH
+#define MAX_PATH 4096
+#endif
+
+typedef uint64_t KAFFINITY;
+
+//cpu set in the windows layout, 64 cpus per group
+struct GROUP_AFFINITY {
+	KAFFINITY Mask;
+	unsigned short Group;
+	unsigned short Reserved[3];
+};
+
+#endif
+
+#endif
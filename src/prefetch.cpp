@@ -0,0 +1,130 @@
+
+#include "prefetch.h"
+
+#include <algorithm>
+#include <cmath>
+#include "common.h"
+
+static const double s_smoothing = 0.2;            //weight of a new sample in the moving averages
+static const double s_maxIntervalMs = 5000;       //longer pauses between requests are not a consumer rate
+static const int s_lowerVotesNeeded = 8;          //requests in a row that must agree before depth shrinks
+static const uint64_t s_minReserveBytes = 1ull << 30;
+
+PrefetchGovernor::PrefetchGovernor(size_t frameBytes, int maxDepth) {
+	this->frameBytes = std::max<size_t>(frameBytes, 1);
+	this->maxDepth = std::max(maxDepth, 1);
+	current.depth = 2;
+	current.cacheFrames = 1;
+}
+
+void PrefetchGovernor::onRequest(bool sequential) {
+	std::lock_guard<std::mutex> guard(lock);
+	auto now = std::chrono::steady_clock::now();
+	if (haveRequest) {
+		double ms = std::chrono::duration<double, std::milli>(now - lastRequest).count();
+		if (ms < s_maxIntervalMs)
+			current.intervalMs = current.intervalMs == 0 ? ms : current.intervalMs + s_smoothing * (ms - current.intervalMs);
+	}
+	lastRequest = now;
+	haveRequest = true;
+	this->sequential = sequential;
+	update();
+}
+
+void PrefetchGovernor::onDecoded(double decodeMs) {
+	std::lock_guard<std::mutex> guard(lock);
+	current.decodeMs = current.decodeMs == 0 ? decodeMs : current.decodeMs + s_smoothing * (decodeMs - current.decodeMs);
+	update();
+}
+
+void PrefetchGovernor::onHit(bool hit, bool reRequest) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (hit)
+		current.hits++;
+	else
+		current.misses++;
+
+	//consumers that go back to frames they already got (scrubbing, temporal filters) want a bigger cache
+	if (reRequest)
+		reRequests = std::min(reRequests + 2, maxDepth * 2);
+	else if (reRequests > 0)
+		reRequests--;
+}
+
+int PrefetchGovernor::depth() {
+	std::lock_guard<std::mutex> guard(lock);
+	return current.depth;
+}
+
+int PrefetchGovernor::cacheFrames() {
+	std::lock_guard<std::mutex> guard(lock);
+	return current.cacheFrames;
+}
+
+size_t PrefetchGovernor::budgetFrames() {
+	std::lock_guard<std::mutex> guard(lock);
+	sampleMemory();
+	return (size_t)((current.budgetMB << 20) / frameBytes);
+}
+
+PrefetchStats PrefetchGovernor::stats() {
+	std::lock_guard<std::mutex> guard(lock);
+	return current;
+}
+
+void PrefetchGovernor::sampleMemory() {
+	auto now = std::chrono::steady_clock::now();
+	if (haveMemory && now - lastMemorySample < std::chrono::milliseconds(250))
+		return;
+
+	uint64_t totalPhys = 0, availPhys = 0;
+	if (!systemMemory(totalPhys, availPhys))
+		return;
+
+	lastMemorySample = now;
+	haveMemory = true;
+
+	//frames we already hold are part of what we may use, otherwise the budget shrinks as soon as we prefetch
+	uint64_t held = (uint64_t)(current.depth + current.cacheFrames) * frameBytes;
+	uint64_t reserve = std::max<uint64_t>(s_minReserveBytes, totalPhys / 8);
+	uint64_t usable = availPhys + held > reserve ? availPhys + held - reserve : 0;
+
+	current.availMB = availPhys >> 20;
+	current.budgetMB = (usable / 2) >> 20; //never take more than half of what is left
+}
+
+void PrefetchGovernor::update() {
+	/* called with lock held */
+	sampleMemory();
+
+	//enough jobs in flight to cover one decode latency at the current consumer rate, plus one spare
+	int wantedDepth;
+	if (!sequential)
+		wantedDepth = 0; //random access, speculation would only decode frames nobody asks for
+	else if (current.decodeMs == 0 || current.intervalMs == 0)
+		wantedDepth = 2;
+	else
+		wantedDepth = (int)std::ceil(current.decodeMs / std::max(current.intervalMs, 1.0)) + 1;
+	wantedDepth = std::min(std::max(wantedDepth, 0), maxDepth);
+
+	int wantedCache = std::min(1 + reRequests, maxDepth * 2);
+
+	int allowedFrames = haveMemory ? (int)std::min<uint64_t>((current.budgetMB << 20) / frameBytes, 1 << 16) : wantedDepth + wantedCache;
+	int depth = std::min(wantedDepth, allowedFrames);
+	int cache = std::max(std::min(wantedCache, allowedFrames - depth), 0);
+	current.memoryLimited = depth < wantedDepth || cache < wantedCache;
+
+	//grow right away, shrink only when it is not a short hiccup of the consumer (unless memory forces it)
+	if (depth < current.depth && !current.memoryLimited && sequential) {
+		if (++lowerVotes < s_lowerVotesNeeded)
+			depth = current.depth;
+		else
+			lowerVotes = 0;
+	}
+	else {
+		lowerVotes = 0;
+	}
+
+	current.depth = depth;
+	current.cacheFrames = cache;
+}
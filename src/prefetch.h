@@ -0,0 +1,58 @@
+
+#ifndef BMDPREFETCHHEADER_H
+#define BMDPREFETCHHEADER_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/* snapshot of the governor decisions, exposed as frame properties when stats=true */
+struct PrefetchStats {
+	int depth = 0;                 //read ahead jobs the governor allows in flight
+	int cacheFrames = 0;           //decoded frames kept around after delivery
+	double decodeMs = 0;           //smoothed submit -> ProcessComplete time
+	double intervalMs = 0;         //smoothed time between consumer requests
+	uint64_t availMB = 0;          //available physical memory at last sample
+	uint64_t budgetMB = 0;         //memory the governor allows for in flight + cached frames
+	bool memoryLimited = false;    //true if depth or cache was cut down because of memory
+	uint64_t hits = 0;             //requests served from prefetched/cached frames
+	uint64_t misses = 0;           //requests that had to submit a new decode
+};
+
+class PrefetchGovernor {
+	/* decides how many frames to decode ahead and how many to keep, from measured
+	   decode time, consumer request rate and available system memory */
+public:
+
+	PrefetchGovernor(size_t frameBytes, int maxDepth);
+
+	void onRequest(bool sequential);
+	void onDecoded(double decodeMs);
+	void onHit(bool hit, bool reRequest);
+
+	int depth();
+	int cacheFrames();
+	size_t budgetFrames();         //frames that fit into the memory budget right now
+	PrefetchStats stats();
+
+private:
+
+	void update();
+	void sampleMemory();
+
+	std::mutex lock;
+	size_t frameBytes;
+	int maxDepth;
+
+	PrefetchStats current;
+	bool sequential = true;
+	int lowerVotes = 0;
+	int reRequests = 0;
+
+	std::chrono::steady_clock::time_point lastRequest;
+	std::chrono::steady_clock::time_point lastMemorySample;
+	bool haveRequest = false;
+	bool haveMemory = false;
+};
+
+#endif
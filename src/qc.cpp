@@ -0,0 +1,135 @@
+#include "qc.h"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+//rec.709 luma weights in 1/65536
+static const uint32_t s_lumaR = 13933;
+static const uint32_t s_lumaG = 46871;
+static const uint32_t s_lumaB = 4732;
+
+void QcStats::addBGRA8(const uint8_t* row, uint32_t count) {
+	/* min/max of 4 pixels per SSE register, the lanes keep their channel. clipping and the histogram are
+	   scalar on the row that is still in cache */
+	__m128i lo = _mm_set1_epi8((char)0xff);
+	__m128i hi = _mm_setzero_si128();
+	uint32_t x = 0;
+	for (; x + 4 <= count; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(row + x * 4));
+		lo = _mm_min_epu8(lo, v);
+		hi = _mm_max_epu8(hi, v);
+	}
+	uint8_t los[16], his[16];
+	_mm_storeu_si128((__m128i*)los, lo);
+	_mm_storeu_si128((__m128i*)his, hi);
+
+	uint8_t rowMin[4] = { 255, 255, 255, 255 };
+	uint8_t rowMax[4] = {};
+	for (int i = 0; i < 16 && count >= 4; i++) {
+		rowMin[i & 3] = std::min(rowMin[i & 3], los[i]);
+		rowMax[i & 3] = std::max(rowMax[i & 3], his[i]);
+	}
+	for (; x < count; x++) {
+		for (int c = 0; c < 4; c++) {
+			rowMin[c] = std::min(rowMin[c], row[x * 4 + c]);
+			rowMax[c] = std::max(rowMax[c], row[x * 4 + c]);
+		}
+	}
+
+	uint64_t low[3] = {}, high[3] = {}, luma = 0;
+	for (x = 0; x < count; x++) {
+		const uint8_t* p = row + x * 4;
+		//BGRA to R,G,B
+		for (int c = 0; c < 3; c++) {
+			low[c] += p[2 - c] == 0;
+			high[c] += p[2 - c] == 255;
+		}
+		uint32_t y = (p[2] * s_lumaR + p[1] * s_lumaG + p[0] * s_lumaB + 32768) >> 16;
+		luma += y;
+		histogram[y >> 2]++;
+	}
+
+	for (int c = 0; c < 3; c++) {
+		min[c] = std::min(min[c], rowMin[2 - c] / 255.0f);
+		max[c] = std::max(max[c], rowMax[2 - c] / 255.0f);
+		clippedLow[c] += low[c];
+		clippedHigh[c] += high[c];
+	}
+	lumaSum += luma / 255.0;
+	pixels += count;
+}
+
+void QcStats::addPlanarU16(const uint16_t* const rows[3], uint32_t count) {
+	uint64_t luma = 0;
+	for (int c = 0; c < 3; c++) {
+		const uint16_t* s = rows[c];
+		uint16_t rowMin = 65535, rowMax = 0;
+		uint64_t low = 0, high = 0;
+		for (uint32_t x = 0; x < count; x++) {
+			rowMin = std::min(rowMin, s[x]);
+			rowMax = std::max(rowMax, s[x]);
+			low += s[x] == 0;
+			high += s[x] == 65535;
+		}
+		min[c] = std::min(min[c], rowMin / 65535.0f);
+		max[c] = std::max(max[c], rowMax / 65535.0f);
+		clippedLow[c] += low;
+		clippedHigh[c] += high;
+	}
+	for (uint32_t x = 0; x < count; x++) {
+		uint32_t y = (uint32_t)(((uint64_t)rows[0][x] * s_lumaR + (uint64_t)rows[1][x] * s_lumaG + (uint64_t)rows[2][x] * s_lumaB + 32768) >> 16);
+		luma += y;
+		histogram[y >> 10]++;
+	}
+	lumaSum += luma / 65535.0;
+	pixels += count;
+}
+
+void QcStats::addPlanarF32(const float* const rows[3], uint32_t count) {
+	for (int c = 0; c < 3; c++) {
+		const float* s = rows[c];
+		float rowMin = min[c], rowMax = max[c];
+		uint64_t low = 0, high = 0;
+		for (uint32_t x = 0; x < count; x++) {
+			rowMin = std::min(rowMin, s[x]);
+			rowMax = std::max(rowMax, s[x]);
+			low += s[x] <= 0.0f;
+			high += s[x] >= 1.0f;
+		}
+		min[c] = rowMin;
+		max[c] = rowMax;
+		clippedLow[c] += low;
+		clippedHigh[c] += high;
+	}
+	double luma = 0;
+	for (uint32_t x = 0; x < count; x++) {
+		float y = 0.2126f * rows[0][x] + 0.7152f * rows[1][x] + 0.0722f * rows[2][x];
+		//nan (a broken frame) counts as black, the range is clamped before the cast, out of range is undefined
+		if (std::isnan(y))
+			y = 0.0f;
+		luma += y;
+		float bin = y * s_qcBins;
+		histogram[bin < 1.0f ? 0 : (bin >= s_qcBins ? s_qcBins - 1 : (int)bin)]++;
+	}
+	lumaSum += luma;
+	pixels += count;
+}
+
+void QcStats::merge(const QcStats& other) {
+	for (int c = 0; c < 3; c++) {
+		min[c] = std::min(min[c], other.min[c]);
+		max[c] = std::max(max[c], other.max[c]);
+		clippedLow[c] += other.clippedLow[c];
+		clippedHigh[c] += other.clippedHigh[c];
+	}
+	for (int i = 0; i < s_qcBins; i++)
+		histogram[i] += other.histogram[i];
+	lumaSum += other.lumaSum;
+	frames += other.frames;
+	pixels += other.pixels;
+}
+
+double QcStats::averageLuma() const {
+	return pixels > 0 ? lumaSum / pixels : 0;
+}
@@ -0,0 +1,28 @@
+
+#ifndef BMDQCHEADER_H
+#define BMDQCHEADER_H
+
+#include <cstdint>
+
+static const int s_qcBins = 64;
+
+struct QcStats {
+	/* picture statistics for QC, gathered from each output row right after the copy stage wrote it, so the
+	   frame is not read a second time. channels are R,G,B, values normalized to 0..1 */
+	uint64_t frames = 0;
+	uint64_t pixels = 0;
+	float min[3] = { 1e30f, 1e30f, 1e30f };
+	float max[3] = { -1e30f, -1e30f, -1e30f };
+	uint64_t clippedLow[3] = {};   //pixels at 0 (or below for float)
+	uint64_t clippedHigh[3] = {};  //pixels at the maximum (or above 1.0 for float)
+	double lumaSum = 0;            //rec.709 luma
+	uint64_t histogram[s_qcBins] = {}; //luma, bin 0 = black
+
+	void addBGRA8(const uint8_t* row, uint32_t count);
+	void addPlanarU16(const uint16_t* const rows[3], uint32_t count);
+	void addPlanarF32(const float* const rows[3], uint32_t count);
+	void merge(const QcStats& other);
+	double averageLuma() const;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "readahead.h"
+
+#include <algorithm>
+#include <chrono>
+#include "common.h"
+
+static const size_t s_chunkBytes = 4 << 20; //one read, large enough for SMB/NFS to stream
+
+FileReadAhead::FileReadAhead(const std::vector<File>& files, size_t windowBytes) {
+	this->windowBytes = std::max(windowBytes, s_chunkBytes);
+	for (const File& file : files) {
+		FileState state;
+		state.file = file;
+		this->files.push_back(state);
+	}
+	buffer.resize(s_chunkBytes);
+	worker = std::thread(&FileReadAhead::run, this);
+}
+
+FileReadAhead::~FileReadAhead() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop = true;
+	}
+	wake.notify_all();
+	worker.join();
+
+	for (FileState& state : files) {
+		if (state.handle != nullptr)
+			closeFile(state.handle);
+	}
+}
+
+void FileReadAhead::onRequest(size_t file, uint64_t frame, bool sequential) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		this->sequential = sequential;
+		cursorFile = file;
+		cursorFrame = frame;
+		cursorVersion++;
+		current.active = sequential;
+	}
+	wake.notify_all();
+}
+
+FileReadStats FileReadAhead::stats() {
+	std::lock_guard<std::mutex> guard(lock);
+	return current;
+}
+
+bool FileReadAhead::prepare(FileState& state) {
+	/* opened with a sequential scan hint, the cache manager then keeps reading ahead on its own as well.
+	   frame offsets are estimated from the bitstream sizes, spread over the whole file so header and
+	   metadata are accounted for roughly */
+	if (state.opened)
+		return state.handle != nullptr;
+	state.opened = true;
+
+	uint64_t size = 0;
+	void* handle = openSequentialRead(state.file.name, size);
+	if (handle == nullptr)
+		return false;
+	state.handle = handle;
+	state.size = size;
+
+	std::vector<uint32_t> sizes;
+	if (state.file.frameSizes)
+		sizes = state.file.frameSizes();
+
+	uint64_t total = 0;
+	for (uint32_t bytes : sizes)
+		total += bytes;
+	if (sizes.size() != state.file.frameCount || total == 0)
+		return true; //equal sized frames in frameOffset
+
+	state.offsets.resize(sizes.size());
+	uint64_t sum = 0;
+	for (size_t i = 0; i < sizes.size(); i++) {
+		state.offsets[i] = (uint64_t)((double)sum / total * state.size);
+		sum += sizes[i];
+	}
+	return true;
+}
+
+uint64_t FileReadAhead::frameOffset(FileState& state, uint64_t frame) {
+	if (frame < state.offsets.size())
+		return state.offsets[frame];
+	if (state.file.frameCount == 0)
+		return 0;
+	return (uint64_t)((double)std::min(frame, state.file.frameCount) / state.file.frameCount * state.size);
+}
+
+void FileReadAhead::run() {
+	/* reads from the decode cursor up to windowBytes ahead of it, continuing into the next file.
+	   the read position restarts at the cursor when the cursor jumps */
+	size_t file = 0;
+	uint64_t position = 0;
+	uint64_t seenVersion = 0;
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (!stop) {
+		if (!sequential) {
+			wake.wait(guard, [&] { return stop || (sequential && cursorVersion != seenVersion); });
+			continue;
+		}
+		size_t targetFile = cursorFile;
+		uint64_t targetFrame = cursorFrame;
+		seenVersion = cursorVersion;
+		guard.unlock();
+
+		bool more = false;
+		FileState& target = files[targetFile];
+		if (prepare(target)) {
+			uint64_t start = frameOffset(target, targetFrame);
+			if (file < targetFile || (file == targetFile && position < start)) {
+				file = targetFile;
+				position = start;
+			}
+
+			//bytes already read ahead of the cursor, we never get further than window + one chunk,
+			//more means the cursor jumped back
+			uint64_t ahead = 0;
+			for (size_t f = targetFile; f < file; f++)
+				ahead += files[f].size;
+			ahead = ahead + position - start;
+			if (ahead > windowBytes + s_chunkBytes) {
+				file = targetFile;
+				position = start;
+				ahead = 0;
+			}
+
+			if (ahead < windowBytes && file < files.size() && prepare(files[file])) {
+				FileState& state = files[file];
+				uint32_t wanted = (uint32_t)std::min<uint64_t>(s_chunkBytes, state.size - position);
+				uint32_t got = 0;
+
+				auto begin = std::chrono::steady_clock::now();
+				bool ok = wanted > 0 && readFileAt(state.handle, position, buffer.data(), wanted, got);
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+				position += got;
+				if (!ok || got == 0 || position >= state.size) {
+					file++;
+					position = 0;
+				}
+				more = file < files.size();
+
+				std::lock_guard<std::mutex> stats(lock);
+				current.bytesRead += got;
+				current.readMs += ms;
+			}
+		}
+
+		guard.lock();
+		if (!more || stop)
+			wake.wait(guard, [&] { return stop || cursorVersion != seenVersion; });
+	}
+}
@@ -0,0 +1,70 @@
+
+#ifndef BMDREADAHEADHEADER_H
+#define BMDREADAHEADHEADER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* what the file read ahead did so far, exposed as frame properties when stats=true */
+struct FileReadStats {
+	uint64_t bytesRead = 0;        //bytes read into the os file cache ahead of the sdk
+	double readMs = 0;             //time spent in these reads
+	bool active = false;           //sequential access, reading ahead
+};
+
+class FileReadAhead {
+	/* the sdk reads each frame at the moment its read job runs, on a NAS every job pays a network round trip.
+	   while the consumer reads sequentially this thread reads large sequential blocks ahead of the decode cursor
+	   through a second handle, so the read jobs find the data in the os file cache. random access pauses it */
+public:
+
+	struct File {
+		std::string name;
+		uint64_t frameCount = 0;
+		//bitstream size of every frame, called on the read ahead thread. empty = frames assumed equal size
+		std::function<std::vector<uint32_t>()> frameSizes;
+	};
+
+	FileReadAhead(const std::vector<File>& files, size_t windowBytes);
+	~FileReadAhead();
+
+	//decode cursor, file and frame within the file
+	void onRequest(size_t file, uint64_t frame, bool sequential);
+	FileReadStats stats();
+
+private:
+
+	struct FileState {
+		File file;
+		void* handle = nullptr;        //openSequentialRead, opened on first use
+		bool opened = false;
+		uint64_t size = 0;
+		std::vector<uint64_t> offsets; //estimated start of every frame
+	};
+
+	void run();
+	bool prepare(FileState& state);
+	uint64_t frameOffset(FileState& state, uint64_t frame);
+
+	std::vector<FileState> files;
+	size_t windowBytes;
+	std::vector<uint8_t> buffer;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stop = false;
+	bool sequential = false;
+	size_t cursorFile = 0;
+	uint64_t cursorFrame = 0;
+	uint64_t cursorVersion = 0;
+	FileReadStats current;
+
+	std::thread worker;
+};
+
+#endif
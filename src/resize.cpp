@@ -0,0 +1,184 @@
+#include "resize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+#include "common.h"
+
+static const double s_pi = 3.14159265358979323846;
+static const int s_lobes = 3;
+
+static double lanczos(double x) {
+	x = std::fabs(x);
+	if (x < 1e-9)
+		return 1.0;
+	if (x >= s_lobes)
+		return 0.0;
+	return s_lobes * std::sin(s_pi * x) * std::sin(s_pi * x / s_lobes) / (s_pi * s_pi * x * x);
+}
+
+Resampler::Filter Resampler::buildFilter(int srcSize, double offset, double size, int outSize) {
+	/* when scaling down the kernel is widened by the scale factor so every source pixel contributes.
+	   taps outside of the picture are folded onto the edge pixels, outside of the region they are real pixels */
+	Filter filter;
+	double scale = size / outSize;
+	double support = s_lobes * std::max(scale, 1.0);
+	double kernelScale = 1.0 / std::max(scale, 1.0);
+
+	filter.taps = std::min((int)std::ceil(support) * 2 + 1, srcSize);
+	filter.start.resize(outSize);
+	filter.weights.assign((size_t)outSize * filter.taps, 0.0f);
+
+	std::vector<double> weights(filter.taps);
+	for (int i = 0; i < outSize; i++) {
+		double center = offset + (i + 0.5) * scale - 0.5;
+		int first = (int)std::floor(center - support) + 1;
+		int last = (int)std::floor(center + support);
+		int start = std::min(std::max(first, 0), srcSize - filter.taps);
+
+		std::fill(weights.begin(), weights.end(), 0.0);
+		double sum = 0;
+		for (int j = first; j <= last; j++) {
+			double w = lanczos((j - center) * kernelScale);
+			int index = std::min(std::max(j, 0), srcSize - 1) - start;
+			if (index < 0 || index >= filter.taps)
+				continue;
+			weights[index] += w;
+			sum += w;
+		}
+		filter.start[i] = start;
+		for (int k = 0; k < filter.taps; k++)
+			filter.weights[(size_t)i * filter.taps + k] = (float)(sum != 0 ? weights[k] / sum : (k == 0));
+	}
+	return filter;
+}
+
+Resampler::Resampler(int srcWidth, int srcHeight, double left, double top, double width, double height, int outWidth, int outHeight) {
+	this->outWidth = outWidth;
+	this->outHeight = outHeight;
+	horizontal = buildFilter(srcWidth, left, width, outWidth);
+	vertical = buildFilter(srcHeight, top, height, outHeight);
+
+	columnFirst = horizontal.start.front();
+	columnCount = horizontal.start.back() + horizontal.taps - columnFirst;
+	useAVX2 = cpuHasAVX2();
+}
+
+Resampler::Plane::Plane(const Resampler& resampler, Format format, int channels, const uint8_t* src, ptrdiff_t pitch) {
+	this->r = &resampler;
+	this->format = format;
+	this->channels = channels;
+	this->src = src;
+	this->pitch = pitch;
+
+	size_t rowFloats = (size_t)resampler.outWidth * channels;
+	ring.resize(rowFloats * resampler.vertical.taps);
+	ringRows.assign(resampler.vertical.taps, -1);
+	line.resize((size_t)resampler.columnCount * channels);
+	acc.resize(rowFloats);
+	rows.resize(resampler.vertical.taps);
+}
+
+const float* Resampler::Plane::horizontalRow(int sy) {
+	/* window starts only move forward, so the rows of one window never share a ring slot */
+	const Filter& h = r->horizontal;
+	int slot = sy % r->vertical.taps;
+	float* out = ring.data() + (size_t)slot * r->outWidth * channels;
+	if (ringRows[slot] == sy)
+		return out;
+	ringRows[slot] = sy;
+
+	const uint8_t* s = src + sy * pitch;
+	const int count = r->columnCount * channels;
+	const int first = r->columnFirst * channels;
+	if (format == U8) {
+		for (int i = 0; i < count; i++)
+			line[i] = s[first + i];
+	}
+	else if (format == U16) {
+		const uint16_t* s16 = (const uint16_t*)s + first;
+		for (int i = 0; i < count; i++)
+			line[i] = s16[i];
+	}
+	else {
+		std::copy((const float*)s + first, (const float*)s + first + count, line.begin());
+	}
+
+	const float* w = h.weights.data();
+	if (channels == 4) {
+		//interleaved BGRA, one pixel per SSE register
+		for (int x = 0; x < r->outWidth; x++, w += h.taps) {
+			const float* in = line.data() + (size_t)(h.start[x] - r->columnFirst) * 4;
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < h.taps; k++)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(in + k * 4)));
+			_mm_storeu_ps(out + x * 4, sum);
+		}
+		return out;
+	}
+
+	for (int x = 0; x < r->outWidth; x++, w += h.taps) {
+		const float* in = line.data() + (size_t)(h.start[x] - r->columnFirst) * channels;
+		for (int c = 0; c < channels; c++) {
+			float sum = 0;
+			for (int k = 0; k < h.taps; k++)
+				sum += w[k] * in[k * channels + c];
+			out[x * channels + c] = sum;
+		}
+	}
+	return out;
+}
+
+void Resampler::Plane::row(int y, uint8_t* dst) {
+	const Filter& v = r->vertical;
+	for (int k = 0; k < v.taps; k++)
+		rows[k] = horizontalRow(v.start[y] + k);
+
+	const int count = r->outWidth * channels;
+	const float* weights = v.weights.data() + (size_t)y * v.taps;
+	float* out = format == F32 ? (float*)dst : acc.data();
+
+	int done = 0;
+	if (r->useAVX2) {
+		done = count & ~7;
+		verticalAVX2(rows.data(), weights, v.taps, out, 0, done);
+	}
+	if (done < count)
+		verticalScalar(rows.data(), weights, v.taps, out, done, count);
+
+	if (format == U8) {
+		for (int i = 0; i < count; i++) {
+			float value = acc[i] + 0.5f;
+			dst[i] = (uint8_t)(value < 0 ? 0 : (value > 255.0f ? 255.0f : value));
+		}
+	}
+	else if (format == U16) {
+		uint16_t* d = (uint16_t*)dst;
+		for (int i = 0; i < count; i++) {
+			float value = acc[i] + 0.5f;
+			d[i] = (uint16_t)(value < 0 ? 0 : (value > 65535.0f ? 65535.0f : value));
+		}
+	}
+}
+
+void Resampler::verticalScalar(const float* const* rows, const float* weights, int taps, float* out, int first, int last) {
+	for (int i = first; i < last; i++) {
+		float sum = 0;
+		for (int k = 0; k < taps; k++)
+			sum += weights[k] * rows[k][i];
+		out[i] = sum;
+	}
+}
+
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+void Resampler::verticalAVX2(const float* const* rows, const float* weights, int taps, float* out, int first, int last) {
+	/* 8 output values per step, all taps are summed in a register before the store */
+	for (int i = first; i < last; i += 8) {
+		__m256 sum = _mm256_setzero_ps();
+		for (int k = 0; k < taps; k++)
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+		_mm256_storeu_ps(out + i, sum);
+	}
+}
@@ -0,0 +1,62 @@
+
+#ifndef BMDRESIZEHEADER_H
+#define BMDRESIZEHEADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Resampler {
+	/* separable lanczos3 from a region of the decoded picture to the output size, runs inside the copy out of
+	   ProcessComplete and writes straight into the output frame. the vertical pass uses AVX2 when the cpu has it */
+public:
+	enum Format { U8, U16, F32 };
+
+	//region in source pixels, may be fractional when the sdk decoded at reduced resolution
+	Resampler(int srcWidth, int srcHeight, double left, double top, double width, double height, int outWidth, int outHeight);
+
+	int outWidth = 0;
+	int outHeight = 0;
+
+	class Plane {
+		/* one plane (or the interleaved BGRA picture) of one frame. horizontally filtered source rows are kept
+		   in a ring as long as the vertical filter needs them, so output rows must be asked for in order */
+	public:
+		Plane(const Resampler& resampler, Format format, int channels, const uint8_t* src, ptrdiff_t pitch);
+		void row(int y, uint8_t* dst);
+
+	private:
+		const float* horizontalRow(int sy);
+
+		const Resampler* r;
+		Format format;
+		int channels;
+		const uint8_t* src;
+		ptrdiff_t pitch;
+		std::vector<float> ring;       //vertical taps rows of outWidth * channels
+		std::vector<int> ringRows;     //source row held by each ring slot, -1 = empty
+		std::vector<float> line;       //source columns touched by the horizontal filter as float
+		std::vector<float> acc;
+		std::vector<const float*> rows;
+	};
+
+private:
+	struct Filter {
+		int taps = 0;
+		std::vector<int> start;        //first source index per output index
+		std::vector<float> weights;    //taps per output index, normalized
+	};
+
+	static Filter buildFilter(int srcSize, double offset, double size, int outSize);
+	//out[i] for first <= i < last, AVX2 needs a multiple of 8 values
+	static void verticalScalar(const float* const* rows, const float* weights, int taps, float* out, int first, int last);
+	static void verticalAVX2(const float* const* rows, const float* weights, int taps, float* out, int first, int last);
+
+	Filter horizontal;
+	Filter vertical;
+	int columnFirst = 0;               //source columns read by the horizontal filter
+	int columnCount = 0;
+	bool useAVX2 = false;
+};
+
+#endif
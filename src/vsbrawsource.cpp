@@ -0,0 +1,394 @@
+/*
+    VapourSynth frontend of BRawSource, the same BRAWSDKProcessor core as the avisynth plugin (brawsource.cpp).
+    Built on linux with vapoursynth/CMakeLists.txt, see there for the sdk location.
+
+    core.braw.Source(file, bits=16, ...) and core.braw.Thumbs(file, step=250, ...), parameters as in BrawSource
+    and BRawThumbs of brawsource.html. The sdk libraries (Blackmagic RAW SDK/Linux/Libraries) are expected in
+    a folder brawsource_dlls next to the plugin, see bmd.cpp acquireFactory
+*/
+
+#include "bmd.h"
+#include "common.h"
+#include <VapourSynth4.h>
+
+#include <cctype>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+class VsOutputFrame : public OutputFrame {
+    /* vapoursynth frame as destination for the bmd copy stage, the sdk writes planar R,G,B straight into
+       planes 0,1,2. the frame stays referenced by the fetch layer cache until it is evicted */
+public:
+    VSFrame* frame;
+    const VSAPI* vsapi;
+
+    VsOutputFrame(VSFrame* dst, const VSAPI* vsapi) : frame(dst), vsapi(vsapi) {
+        numPlanes = 3;
+        for (int p = 0; p < 3; p++) {
+            planes[p] = vsapi->getWritePtr(frame, p);
+            pitches[p] = (int)vsapi->getStride(frame, p);
+        }
+    }
+
+    ~VsOutputFrame() {
+        vsapi->freeFrame(frame);
+    }
+};
+
+struct BRawVsSource {
+    VSVideoInfo vi = {};
+    std::shared_ptr<BRAWSDKProcessor> bmdproc;
+    bool stats = false;
+    bool metadata = false;
+    bool qc = false;
+
+    OutputAllocator allocator(VSCore* core, const VSAPI* vsapi) {
+        //frames for the requested frame and for everything the governor reads ahead
+        return [this, core, vsapi]() {
+            return std::make_shared<VsOutputFrame>(vsapi->newVideoFrame(&vi.format, vi.width, vi.height, nullptr, core), vsapi);
+        };
+    }
+};
+
+static void SetStatsProps(VSMap* props, BRAWSDKProcessor& proc, const DecodedFrame& frame, const VSAPI* vsapi) {
+    //same properties as the avisynth plugin with stats=true
+    PrefetchStats st = proc.prefetchStats();
+    FileReadStats io = proc.fileReadStats();
+    CompressedCacheStats compressed = proc.compressedCacheStats();
+    vsapi->mapSetInt(props, "BRawReadAhead", frame.readAhead ? 1 : 0, maReplace);
+    vsapi->mapSetFloat(props, "BRawReadMs", frame.readMs, maReplace);
+    vsapi->mapSetInt(props, "BRawFileReadAheadMB", (int64_t)(io.bytesRead >> 20), maReplace);
+    vsapi->mapSetFloat(props, "BRawFileReadAheadMs", io.readMs, maReplace);
+    vsapi->mapSetInt(props, "BRawCompressedHit", frame.compressedHit ? 1 : 0, maReplace);
+    vsapi->mapSetInt(props, "BRawCompressedCacheMB", (int64_t)(compressed.bytes >> 20), maReplace);
+    vsapi->mapSetInt(props, "BRawCompressedCacheFrames", (int64_t)compressed.frames, maReplace);
+    vsapi->mapSetInt(props, "BRawSharedDecode", frame.sharedDecode ? 1 : 0, maReplace);
+    vsapi->mapSetInt(props, "BRawPrefetchDepth", st.depth, maReplace);
+    vsapi->mapSetInt(props, "BRawCacheFrames", st.cacheFrames, maReplace);
+    vsapi->mapSetFloat(props, "BRawDecodeMs", st.decodeMs, maReplace);
+    vsapi->mapSetFloat(props, "BRawRequestIntervalMs", st.intervalMs, maReplace);
+    vsapi->mapSetInt(props, "BRawAvailMemMB", (int64_t)st.availMB, maReplace);
+    vsapi->mapSetInt(props, "BRawBudgetMB", (int64_t)st.budgetMB, maReplace);
+    vsapi->mapSetInt(props, "BRawMemoryLimited", st.memoryLimited ? 1 : 0, maReplace);
+    vsapi->mapSetInt(props, "BRawCacheHits", (int64_t)st.hits, maReplace);
+    vsapi->mapSetInt(props, "BRawCacheMisses", (int64_t)st.misses, maReplace);
+}
+
+static void SetMetadataProp(VSMap* props, const MetadataValue& value, const VSAPI* vsapi) {
+    //camera keys like "lens_type" become "BRaw_lens_type"
+    std::string key = "BRaw_" + value.key;
+    for (char& c : key) {
+        if (!isalnum((unsigned char)c))
+            c = '_';
+    }
+
+    if (value.type == MetadataValue::String)
+        vsapi->mapSetData(props, key.c_str(), value.text.c_str(), (int)value.text.size(), dtUtf8, maReplace);
+    else if (value.type == MetadataValue::Float)
+        vsapi->mapSetFloatArray(props, key.c_str(), value.floats.data(), (int)value.floats.size());
+    else
+        vsapi->mapSetIntArray(props, key.c_str(), value.ints.data(), (int)value.ints.size());
+}
+
+static void SetMetadataProps(VSMap* props, const DecodedFrame& frame, const VSAPI* vsapi) {
+    //clip values first, per frame values of the same key win
+    if (frame.clipMetadata) {
+        for (const MetadataValue& value : *frame.clipMetadata)
+            SetMetadataProp(props, value, vsapi);
+    }
+    for (const MetadataValue& value : frame.frameMetadata)
+        SetMetadataProp(props, value, vsapi);
+
+    if (!frame.timecode.empty())
+        vsapi->mapSetData(props, "BRawTimecode", frame.timecode.c_str(), (int)frame.timecode.size(), dtUtf8, maReplace);
+}
+
+static void SetQcStatsProps(VSMap* props, const char* prefix, const QcStats& qc, const VSAPI* vsapi) {
+    //R,G,B arrays, normalized to 0..1
+    std::string key(prefix);
+    double values[3];
+    int64_t counts[3];
+
+    for (int c = 0; c < 3; c++)
+        values[c] = qc.pixels > 0 ? qc.min[c] : 0;
+    vsapi->mapSetFloatArray(props, (key + "Min").c_str(), values, 3);
+    for (int c = 0; c < 3; c++)
+        values[c] = qc.pixels > 0 ? qc.max[c] : 0;
+    vsapi->mapSetFloatArray(props, (key + "Max").c_str(), values, 3);
+    for (int c = 0; c < 3; c++)
+        counts[c] = (int64_t)qc.clippedLow[c];
+    vsapi->mapSetIntArray(props, (key + "ClippedLow").c_str(), counts, 3);
+    for (int c = 0; c < 3; c++)
+        counts[c] = (int64_t)qc.clippedHigh[c];
+    vsapi->mapSetIntArray(props, (key + "ClippedHigh").c_str(), counts, 3);
+    vsapi->mapSetFloat(props, (key + "AverageLuma").c_str(), qc.averageLuma(), maReplace);
+}
+
+static void SetQcProps(VSMap* props, BRAWSDKProcessor& proc, const DecodedFrame& frame, const VSAPI* vsapi) {
+    //this frame, and the summary over all frames delivered so far
+    SetQcStatsProps(props, "BRawQc", frame.qc, vsapi);
+
+    int64_t histogram[s_qcBins];
+    for (int i = 0; i < s_qcBins; i++)
+        histogram[i] = (int64_t)frame.qc.histogram[i];
+    vsapi->mapSetIntArray(props, "BRawQcHistogram", histogram, s_qcBins);
+
+    QcStats clip = proc.qcSummary();
+    SetQcStatsProps(props, "BRawQcClip", clip, vsapi);
+    vsapi->mapSetInt(props, "BRawQcClipFrames", (int64_t)clip.frames, maReplace);
+}
+
+static const VSFrame* VS_CC BRawGetFrame(int n, int activationReason, void* instanceData, void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi) {
+    /* a source has no input frames to wait for, everything happens in arInitial. the filter is fmParallelRequests,
+       vapoursynth calls arInitial from all its threads at once, so every thread has its own sdk job in flight on top
+       of what the governor reads ahead, and the copy out of ProcessComplete fills the frame we return.
+       api 4 has no way to complete a frame from another thread, so arInitial waits for the sdk completion */
+    BRawVsSource* d = (BRawVsSource*)instanceData;
+    if (activationReason != arInitial)
+        return nullptr;
+
+    std::shared_ptr<DecodedFrame> frame;
+    try {
+        frame = d->bmdproc->fetchFrame(n, d->allocator(core, vsapi));
+    }
+    catch (std::runtime_error& e) {
+        std::string msg = std::string("BRawSource: ") + e.what();
+        vsapi->setFilterError(msg.c_str(), frameCtx);
+        return nullptr;
+    }
+
+    //the decoded frame stays in the cache, the copy shares its pixels and gets its own properties
+    VSFrame* dst = vsapi->copyFrame(static_cast<VsOutputFrame*>(frame->output.get())->frame, core);
+    VSMap* props = vsapi->getFramePropertiesRW(dst);
+    vsapi->mapSetInt(props, "_DurationNum", d->vi.fpsDen, maReplace);
+    vsapi->mapSetInt(props, "_DurationDen", d->vi.fpsNum, maReplace);
+    vsapi->mapSetInt(props, "_Matrix", 0, maReplace);     //rgb
+    vsapi->mapSetInt(props, "_ColorRange", 0, maReplace); //full range
+
+    if (d->stats)
+        SetStatsProps(props, *d->bmdproc, *frame, vsapi);
+    if (d->metadata)
+        SetMetadataProps(props, *frame, vsapi);
+    if (d->qc)
+        SetQcProps(props, *d->bmdproc, *frame, vsapi);
+
+    return dst;
+}
+
+static void VS_CC BRawFree(void* instanceData, VSCore* core, const VSAPI* vsapi) {
+    /* the core is still alive here. the processor detaches first: jobs in flight stop copying into it and
+       the sdk threads drop their frames of this source, then the cached frames are freed on this thread */
+    BRawVsSource* d = (BRawVsSource*)instanceData;
+    d->bmdproc.reset();
+    delete d;
+}
+
+static bool HasArg(const VSMap* in, const char* key, const VSAPI* vsapi) {
+    return vsapi->mapNumElements(in, key) > 0;
+}
+
+static int64_t IntArg(const VSMap* in, const char* key, int64_t def, const VSAPI* vsapi) {
+    int err = 0;
+    int64_t value = vsapi->mapGetInt(in, key, 0, &err);
+    return err ? def : value;
+}
+
+static double FloatArg(const VSMap* in, const char* key, double def, const VSAPI* vsapi) {
+    int err = 0;
+    double value = vsapi->mapGetFloat(in, key, 0, &err);
+    return err ? def : value;
+}
+
+static std::string StringArg(const VSMap* in, const char* key, const char* def, const VSAPI* vsapi) {
+    int err = 0;
+    const char* value = vsapi->mapGetData(in, key, 0, &err);
+    return err ? def : value;
+}
+
+static long long FramePosition(const VSMap* in, const char* key, BRAWSDKProcessor& proc, long long def, const VSAPI* vsapi) {
+    //start/end can be a frame number or a timecode string
+    int type = vsapi->mapGetType(in, key);
+    if (type == ptUnset)
+        return def;
+    if (type == ptInt)
+        return vsapi->mapGetInt(in, key, 0, nullptr);
+    if (type == ptData)
+        return proc.frameForTimecode(vsapi->mapGetData(in, key, 0, nullptr));
+    throw std::runtime_error("start and end must be a frame number or a timecode like \"01:00:10:00\"");
+}
+
+static void CreateSource(const VSMap* in, VSMap* out, const char* name, const std::vector<std::string>& files, int bitmode, bool stats,
+    const ProcessorOptions& options, int step, VSCore* core, const VSAPI* vsapi) {
+    std::unique_ptr<BRawVsSource> d(new BRawVsSource());
+    d->stats = stats;
+    d->metadata = options.metadata;
+    d->qc = options.qc;
+    d->bmdproc = std::make_shared<BRAWSDKProcessor>();
+    //several files are presented as one clip with a global frame index
+    d->bmdproc->openFile(files, bitmode, options);
+
+    //subclip, everything below (frames, read ahead) stays inside of it
+    long long first = FramePosition(in, "start", *d->bmdproc, 0, vsapi);
+    long long last = FramePosition(in, "end", *d->bmdproc, (long long)d->bmdproc->frameCount - 1, vsapi);
+    validate(first < 0 || last < 0, "start/end is before the first frame of the clip");
+    d->bmdproc->setRange(first, last, step);
+
+    //blackmagicRawResourceFormatRGBU16Planar and RGBF32Planar, see openFile
+    vsapi->getVideoFormatByID(&d->vi.format, bitmode == 16 ? pfRGB48 : pfRGBS, core);
+    d->vi.width = d->bmdproc->width;
+    d->vi.height = d->bmdproc->height;
+    d->vi.fpsNum = d->bmdproc->framerate_num;
+    d->vi.fpsDen = d->bmdproc->framerate_den;
+    d->vi.numFrames = (int)d->bmdproc->rangeFrames;
+
+    //the first frame decodes while vapoursynth goes on with the rest of the script,
+    //sampled frames (Thumbs) are all submitted at once and decode in parallel
+    d->bmdproc->warmUp(d->allocator(core, vsapi), step > 1 ? d->bmdproc->rangeFrames : 1);
+
+    vsapi->createVideoFilter(out, name, &d->vi, BRawGetFrame, BRawFree, fmParallelRequests, nullptr, 0, d.release(), core);
+}
+
+static int ParallelRequests(VSCore* core, const VSAPI* vsapi) {
+    VSCoreInfo info = {};
+    vsapi->getCoreInfo(core, &info);
+    return info.numThreads;
+}
+
+static void VS_CC BRawSourceCreate(const VSMap* in, VSMap* out, void* userData, VSCore* core, const VSAPI* vsapi) {
+    try {
+        //no packed bgra in vapoursynth, so no 8 bit output
+        int bitmode = (int)IntArg(in, "bits", 16, vsapi);
+        validate(!(bitmode == 16 || bitmode == 32), "bits must be 16 or 32");
+
+        bool stats = IntArg(in, "stats", 0, vsapi) != 0;
+
+        ProcessorOptions options;
+        options.threads = (int)IntArg(in, "threads", 0, vsapi);
+        options.numaNode = (int)IntArg(in, "numa_node", -1, vsapi);
+        options.affinity = StringArg(in, "affinity", "", vsapi);
+        validate(options.threads < 0, "threads must be 0 (sdk default) or more");
+        options.parallelRequests = ParallelRequests(core, vsapi);
+
+        //raw processing, everything not given stays as recorded by the camera
+        options.setIso = HasArg(in, "iso", vsapi);
+        options.iso = (uint32_t)IntArg(in, "iso", 0, vsapi);
+        options.setKelvin = HasArg(in, "kelvin", vsapi);
+        options.kelvin = (uint32_t)IntArg(in, "kelvin", 0, vsapi);
+        options.setTint = HasArg(in, "tint", vsapi);
+        options.tint = (int)IntArg(in, "tint", 0, vsapi);
+        options.setExposure = HasArg(in, "exposure", vsapi);
+        options.exposure = (float)FloatArg(in, "exposure", 0, vsapi);
+        options.gamma = StringArg(in, "gamma", "", vsapi);
+        options.gamut = StringArg(in, "gamut", "", vsapi);
+        validate(options.setIso && IntArg(in, "iso", 0, vsapi) <= 0, "iso must be positive");
+        validate(options.setKelvin && IntArg(in, "kelvin", 0, vsapi) <= 0, "kelvin must be positive");
+
+        //3d lut fused into the copy out of the sdk
+        options.lut = StringArg(in, "lut", "", vsapi);
+
+        options.metadata = IntArg(in, "metadata", 1, vsapi) != 0;
+
+        //crop and resize in the copy out of the sdk, decoded at reduced resolution where that is enough
+        if (HasArg(in, "crop", vsapi)) {
+            validate(vsapi->mapNumElements(in, "crop") != 4, "crop must be [left, top, width, height] like std.Crop, e.g. [960, 540, -960, -540]");
+            options.crop = true;
+            options.cropLeft = vsapi->mapGetIntSaturated(in, "crop", 0, nullptr);
+            options.cropTop = vsapi->mapGetIntSaturated(in, "crop", 1, nullptr);
+            options.cropWidth = vsapi->mapGetIntSaturated(in, "crop", 2, nullptr);
+            options.cropHeight = vsapi->mapGetIntSaturated(in, "crop", 3, nullptr);
+        }
+        if (HasArg(in, "resize", vsapi)) {
+            validate(vsapi->mapNumElements(in, "resize") != 2, "resize must be [width, height], e.g. [1920, 1080] or [1920, 0] to keep the aspect ratio");
+            options.resizeWidth = vsapi->mapGetIntSaturated(in, "resize", 0, nullptr);
+            options.resizeHeight = vsapi->mapGetIntSaturated(in, "resize", 1, nullptr);
+            validate(options.resizeWidth < 0 || options.resizeHeight < 0 || (options.resizeWidth == 0 && options.resizeHeight == 0), "resize width and height must be positive");
+        }
+
+        //file list, wildcard or card span
+        std::vector<std::string> files = expandSources(StringArg(in, "file", "", vsapi).c_str(), IntArg(in, "span", 0, vsapi) != 0);
+        validate(files.empty(), "No source specified");
+
+        //read ahead on the file level only pays off where every read is a network round trip
+        options.readAheadMB = (int)IntArg(in, "readahead_mb", isNetworkPath(files[0]) ? 256 : 0, vsapi);
+        validate(options.readAheadMB < 0, "readahead_mb must be 0 (off) or more");
+
+        //compressed frames are small, scrubbing back only pays the decode
+        options.compressedCacheMB = (int)IntArg(in, "compressed_cache_mb", 1024, vsapi);
+        validate(options.compressedCacheMB < 0, "compressed_cache_mb must be 0 (off) or more");
+
+        //picture statistics gathered while the frame is copied out of the sdk
+        options.qc = IntArg(in, "qc", 0, vsapi) != 0;
+
+        CreateSource(in, out, "BRawSource", files, bitmode, stats, options, 1, core, vsapi);
+    }
+    catch (std::runtime_error& e) {
+        std::string msg = std::string("Source: ") + e.what();
+        vsapi->mapSetError(out, msg.c_str());
+    }
+}
+
+static void VS_CC BRawThumbsCreate(const VSMap* in, VSMap* out, void* userData, VSCore* core, const VSAPI* vsapi) {
+    try {
+        int step = (int)IntArg(in, "step", 250, vsapi);
+        validate(step < 1, "step must be 1 or more");
+
+        int bitmode = (int)IntArg(in, "bits", 16, vsapi);
+        validate(!(bitmode == 16 || bitmode == 32), "bits must be 16 or 32");
+
+        //previews are decoded small, the sdk does far less work than for a full frame
+        ProcessorOptions options;
+        options.scale = (int)IntArg(in, "scale", 8, vsapi);
+        options.parallelRequests = ParallelRequests(core, vsapi);
+
+        std::vector<std::string> files = expandSources(StringArg(in, "file", "", vsapi).c_str(), IntArg(in, "span", 0, vsapi) != 0);
+        validate(files.empty(), "No source specified");
+
+        CreateSource(in, out, "BRawThumbs", files, bitmode, false, options, step, core, vsapi);
+    }
+    catch (std::runtime_error& e) {
+        std::string msg = std::string("Thumbs: ") + e.what();
+        vsapi->mapSetError(out, msg.c_str());
+    }
+}
+
+VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin* plugin, const VSPLUGINAPI* vspapi) {
+    vspapi->configPlugin("com.emcodem.brawsource", "braw", "BRawSource, decodes Blackmagic BRAW files",
+        VS_MAKE_VERSION(1, 0), VAPOURSYNTH_API_VERSION, 0, plugin);
+
+    const char* args =
+        "file:data;"
+        "bits:int:opt;"
+        "stats:int:opt;"
+        "threads:int:opt;"
+        "numa_node:int:opt;"
+        "affinity:data:opt;"
+        "start:any:opt;"
+        "end:any:opt;"
+        "span:int:opt;"
+        "iso:int:opt;"
+        "kelvin:int:opt;"
+        "tint:int:opt;"
+        "exposure:float:opt;"
+        "gamma:data:opt;"
+        "gamut:data:opt;"
+        "lut:data:opt;"
+        "metadata:int:opt;"
+        "crop:int[]:opt;"
+        "resize:int[]:opt;"
+        "readahead_mb:int:opt;"
+        "compressed_cache_mb:int:opt;"
+        "qc:int:opt;";
+
+    vspapi->registerFunction("Source", args, "clip:vnode;", BRawSourceCreate, nullptr, plugin);
+
+    const char* thumbArgs =
+        "file:data;"
+        "step:int:opt;"
+        "scale:int:opt;"
+        "bits:int:opt;"
+        "span:int:opt;";
+
+    vspapi->registerFunction("Thumbs", thumbArgs, "clip:vnode;", BRawThumbsCreate, nullptr, plugin);
+}
+
@@ -0,0 +1,97 @@
+/* random access while the read ahead queue of the decoder is full. the sdk gets at most s_maxStartedJobs read
+   ahead jobs, the rest waits in the decoder, so a seek only waits behind what the sdk already has. the demand to
+   delivery time of the same seeks is measured with read ahead off (only jumps, the governor keeps depth 0) and
+   right after playback, with the first frame of other sources on the same decoder filling the queue */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "memoryframe.h"
+#include "synthetic.h"
+
+static const size_t s_maxStartedJobs = 4; //see bmd.cpp
+static const int s_decodeMs = 20;
+static const int s_threads = 2;
+static const int s_seeks = 24;
+static const int s_playFrames = 24;
+static const int s_maxReadAhead = 16; //see bmd.cpp
+
+struct Latency {
+	double medianMs = 0;
+	double worstMs = 0;
+	int depth = 0;                 //read ahead depth of the seeking source right before the last seek
+};
+
+static Latency summarize(std::vector<double> ms, int depth) {
+	std::sort(ms.begin(), ms.end());
+	Latency latency;
+	latency.medianMs = ms[ms.size() / 2];
+	latency.worstMs = ms.back();
+	latency.depth = depth;
+	return latency;
+}
+
+static Latency seek(const std::vector<int>& targets, bool readAhead) {
+	ProcessorOptions options;
+	options.threads = s_threads;
+	options.metadata = false;
+	BRAWSDKProcessor proc;
+	proc.openFile({ "seek.braw" }, 16, options);
+	proc.setRange(0, proc.frameCount - 1);
+	OutputAllocator allocate = memoryFrames(proc, 16);
+
+	std::vector<double> ms;
+	int depth = 0;
+	for (int target : targets) {
+		//playback right in front of the seek, the consumer is faster than the decoder
+		std::vector<std::unique_ptr<BRAWSDKProcessor>> others;
+		if (readAhead) {
+			int from = (target + (int)proc.frameCount / 2) % ((int)proc.frameCount - s_playFrames);
+			for (int n = from; n < from + s_playFrames; n++)
+				CHECK(proc.fetchFrame(n, allocate)->done);
+
+			//and more read ahead than the sdk gets at once, a jump of the seeking source cannot cancel it
+			for (int i = 0; i < s_maxReadAhead; i++) {
+				others.emplace_back(new BRAWSDKProcessor());
+				others.back()->openFile({ "seek.braw" }, 16, options);
+				others.back()->setRange(from + s_playFrames * 2 + i, others.back()->frameCount - 1);
+				others.back()->warmUp(memoryFrames(*others.back(), 16));
+			}
+		}
+		depth = proc.prefetchStats().depth;
+
+		auto demanded = std::chrono::steady_clock::now();
+		CHECK(proc.fetchFrame(target, allocate)->done);
+		ms.push_back(elapsedMs(demanded));
+	}
+	return summarize(ms, depth);
+}
+
+int main() {
+	synthetic::Clip clip;
+	clip.frameCount = 20000;
+	synthetic::setClip(clip);
+	synthetic::setDecodeMs(s_decodeMs);
+
+	std::mt19937 random(1);
+	std::vector<int> targets;
+	for (int i = 0; i < s_seeks; i++)
+		targets.push_back((int)(random() % clip.frameCount));
+
+	Latency off = seek(targets, false);
+	Latency full = seek(targets, true);
+
+	printf("%d seeks, %d ms decode on %d sdk threads\n", s_seeks, s_decodeMs, s_threads);
+	printf("read ahead off:  median %.1f ms, worst %.1f ms\n", off.medianMs, off.worstMs);
+	printf("read ahead full: median %.1f ms, worst %.1f ms (depth %d before the seek)\n", full.medianMs, full.worstMs, full.depth);
+	printf("behind the whole queue it would be %d ms\n", s_decodeMs * (s_maxReadAhead / s_threads + 1));
+
+	//the seeking source itself was reading ahead, otherwise this measures nothing
+	CHECK(full.depth > 0);
+	//the seek waits for the started read ahead at most, never for the whole queue behind it
+	double bound = off.worstMs + (double)s_decodeMs * s_maxStartedJobs / s_threads + s_decodeMs;
+	CHECK(full.worstMs < bound);
+	return 0;
+}
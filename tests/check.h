@@ -0,0 +1,22 @@
+
+#ifndef BMDTESTCHECKHEADER_H
+#define BMDTESTCHECKHEADER_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+//minimal assertions for the test executables, a failed check ends the test with exit code 1
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			exit(1); \
+		} \
+	} while (0)
+
+static inline double elapsedMs(std::chrono::steady_clock::time_point since) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+#endif
@@ -0,0 +1,34 @@
+
+#ifndef BMDTESTMEMORYFRAMEHEADER_H
+#define BMDTESTMEMORYFRAMEHEADER_H
+
+#include <vector>
+
+#include "bmd.h"
+
+class MemoryFrame : public OutputFrame {
+	/* output frame on the heap in the layout of the avisynth frames, bgra for 8 bit, planar R,G,B otherwise */
+public:
+	MemoryFrame(int width, int height, int bitmode) {
+		int bytes = bitmode == 8 ? 4 : bitmode / 8;
+		numPlanes = bitmode == 8 ? 1 : 3;
+		int pitch = (width * bytes + 63) & ~63;
+		pixels.resize((size_t)pitch * height * numPlanes);
+		for (int p = 0; p < numPlanes; p++) {
+			planes[p] = pixels.data() + (size_t)pitch * height * p;
+			pitches[p] = pitch;
+		}
+	}
+
+private:
+	std::vector<uint8_t> pixels;
+};
+
+static inline OutputAllocator memoryFrames(const BRAWSDKProcessor& proc, int bitmode) {
+	int width = proc.width, height = proc.height;
+	return [width, height, bitmode]() {
+		return std::make_shared<MemoryFrame>(width, height, bitmode);
+	};
+}
+
+#endif
@@ -0,0 +1,272 @@
+
+#ifndef BMDSYNTHETICAPIHEADER_H
+#define BMDSYNTHETICAPIHEADER_H
+
+/* the part of the linux Blackmagic RAW SDK interface that bmd.cpp uses, with the same names and signatures.
+   synthetic.cpp implements it without any decoding, so the core can be tested without the SDK */
+
+#include <cstddef>
+#include <cstdint>
+
+typedef int32_t HRESULT;
+typedef uint32_t ULONG;
+typedef void* LPVOID;
+
+struct REFIID {
+	uint8_t bytes[16];
+};
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_UNEXPECTED ((HRESULT)0x8000FFFF)
+#define E_NOTIMPL ((HRESULT)0x80004001)
+#define E_NOINTERFACE ((HRESULT)0x80004002)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define E_ABORT ((HRESULT)0x80004004)
+#define E_POINTER ((HRESULT)0x80004003)
+#define SUCCEEDED(x) ((HRESULT)(x) >= 0)
+#define FAILED(x) ((HRESULT)(x) < 0)
+
+struct IUnknown {
+	virtual HRESULT QueryInterface(REFIID iid, LPVOID* object) = 0;
+	virtual ULONG AddRef() = 0;
+	virtual ULONG Release() = 0;
+};
+
+enum BlackmagicRawVariantType {
+	blackmagicRawVariantTypeEmpty,
+	blackmagicRawVariantTypeU8,
+	blackmagicRawVariantTypeS16,
+	blackmagicRawVariantTypeU16,
+	blackmagicRawVariantTypeS32,
+	blackmagicRawVariantTypeU32,
+	blackmagicRawVariantTypeFloat32,
+	blackmagicRawVariantTypeString,
+	blackmagicRawVariantTypeSafeArray,
+	blackmagicRawVariantTypeFloat64
+};
+
+struct SafeArrayBound {
+	uint32_t lLbound;
+	uint32_t cElements;
+};
+
+struct SafeArray {
+	BlackmagicRawVariantType variantType;
+	uint32_t cDims;
+	void* data;
+	SafeArrayBound bounds;
+};
+
+struct Variant {
+	BlackmagicRawVariantType vt;
+	union {
+		int16_t iVal;
+		uint16_t uiVal;
+		int32_t intVal;
+		uint32_t uintVal;
+		float fltVal;
+		double dblVal;
+		const char* bstrVal;
+		SafeArray* parray;
+	};
+};
+
+extern "C" {
+HRESULT VariantInit(Variant* variant);
+HRESULT VariantClear(Variant* variant);
+HRESULT SafeArrayGetVartype(SafeArray* array, BlackmagicRawVariantType* type);
+HRESULT SafeArrayGetLBound(SafeArray* array, uint32_t dimension, long* bound);
+HRESULT SafeArrayGetUBound(SafeArray* array, uint32_t dimension, long* bound);
+HRESULT SafeArrayAccessData(SafeArray* array, void** data);
+HRESULT SafeArrayUnaccessData(SafeArray* array);
+}
+
+enum BlackmagicRawResourceFormat {
+	blackmagicRawResourceFormatRGBAU8,
+	blackmagicRawResourceFormatBGRAU8,
+	blackmagicRawResourceFormatRGBU16,
+	blackmagicRawResourceFormatRGBAU16,
+	blackmagicRawResourceFormatBGRAU16,
+	blackmagicRawResourceFormatRGBU16Planar,
+	blackmagicRawResourceFormatRGBF32,
+	blackmagicRawResourceFormatRGBF32Planar,
+	blackmagicRawResourceFormatBGRAF32
+};
+
+enum BlackmagicRawResolutionScale {
+	blackmagicRawResolutionScaleFull,
+	blackmagicRawResolutionScaleHalf,
+	blackmagicRawResolutionScaleQuarter,
+	blackmagicRawResolutionScaleEighth
+};
+
+enum BlackmagicRawPipeline {
+	blackmagicRawPipelineCPU,
+	blackmagicRawPipelineCUDA,
+	blackmagicRawPipelineOpenCL
+};
+
+enum BlackmagicRawResourceType {
+	blackmagicRawResourceTypeBufferCPU
+};
+
+enum BlackmagicRawClipProcessingAttribute {
+	blackmagicRawClipProcessingAttributeColorScienceGen,
+	blackmagicRawClipProcessingAttributeGamma,
+	blackmagicRawClipProcessingAttributeGamut,
+	blackmagicRawClipProcessingAttributeToneCurveContrast,
+	blackmagicRawClipProcessingAttributeHighlightRecovery,
+	blackmagicRawClipProcessingAttributePost3DLUTMode,
+	blackmagicRawClipProcessingAttributeEmbeddedPost3DLUTName,
+	blackmagicRawClipProcessingAttributeSidecarPost3DLUTName
+};
+
+enum BlackmagicRawFrameProcessingAttribute {
+	blackmagicRawFrameProcessingAttributeWhiteBalanceKelvin,
+	blackmagicRawFrameProcessingAttributeWhiteBalanceTint,
+	blackmagicRawFrameProcessingAttributeExposure,
+	blackmagicRawFrameProcessingAttributeISO,
+	blackmagicRawFrameProcessingAttributeAnalogGain
+};
+
+struct IBlackmagicRawJob : IUnknown {
+	virtual HRESULT Submit() = 0;
+	virtual HRESULT Abort() = 0;
+	virtual HRESULT SetUserData(void* userData) = 0;
+	virtual HRESULT GetUserData(void** userData) = 0;
+};
+
+struct IBlackmagicRawMetadataIterator : IUnknown {
+	virtual HRESULT Next() = 0;
+	virtual HRESULT GetKey(const char** key) = 0;
+	virtual HRESULT GetData(Variant* data) = 0;
+};
+
+struct IBlackmagicRawPost3DLUT : IUnknown {
+	virtual HRESULT GetName(const char** name) = 0;
+	virtual HRESULT GetTitle(const char** title) = 0;
+	virtual HRESULT GetSize(uint32_t* size) = 0;
+	virtual HRESULT GetResourceCPU(void** resource) = 0;
+	virtual HRESULT GetResourceSizeBytes(uint32_t* sizeBytes) = 0;
+};
+
+struct IBlackmagicRawClipProcessingAttributes : IUnknown {
+	virtual HRESULT GetClipAttribute(BlackmagicRawClipProcessingAttribute attribute, Variant* value) = 0;
+	virtual HRESULT SetClipAttribute(BlackmagicRawClipProcessingAttribute attribute, Variant* value) = 0;
+	virtual HRESULT GetPost3DLUT(IBlackmagicRawPost3DLUT** lut) = 0;
+};
+
+struct IBlackmagicRawFrameProcessingAttributes : IUnknown {
+	virtual HRESULT GetFrameAttribute(BlackmagicRawFrameProcessingAttribute attribute, Variant* value) = 0;
+	virtual HRESULT SetFrameAttribute(BlackmagicRawFrameProcessingAttribute attribute, Variant* value) = 0;
+};
+
+struct IBlackmagicRawFrame : IUnknown {
+	virtual HRESULT GetFrameIndex(uint64_t* frameIndex) = 0;
+	virtual HRESULT GetTimecode(const char** timecode) = 0;
+	virtual HRESULT GetMetadataIterator(IBlackmagicRawMetadataIterator** iterator) = 0;
+	virtual HRESULT GetMetadata(const char* key, Variant* value) = 0;
+	virtual HRESULT CloneFrameProcessingAttributes(IBlackmagicRawFrameProcessingAttributes** attributes) = 0;
+	virtual HRESULT SetResolutionScale(BlackmagicRawResolutionScale scale) = 0;
+	virtual HRESULT GetResolutionScale(BlackmagicRawResolutionScale* scale) = 0;
+	virtual HRESULT SetResourceFormat(BlackmagicRawResourceFormat format) = 0;
+	virtual HRESULT GetResourceFormat(BlackmagicRawResourceFormat* format) = 0;
+	virtual HRESULT CreateJobDecodeAndProcessFrame(IBlackmagicRawClipProcessingAttributes* clipAttributes,
+		IBlackmagicRawFrameProcessingAttributes* frameAttributes, IBlackmagicRawJob** job) = 0;
+};
+
+struct IBlackmagicRawFrameEx : IUnknown {
+	virtual HRESULT GetBitStreamSizeBytes(uint32_t* sizeBytes) = 0;
+	virtual HRESULT GetProcessedImageResolution(uint32_t* width, uint32_t* height) = 0;
+};
+
+struct IBlackmagicRawProcessedImage : IUnknown {
+	virtual HRESULT GetWidth(uint32_t* width) = 0;
+	virtual HRESULT GetHeight(uint32_t* height) = 0;
+	virtual HRESULT GetResource(void** resource) = 0;
+	virtual HRESULT GetResourceType(BlackmagicRawResourceType* type) = 0;
+	virtual HRESULT GetResourceFormat(BlackmagicRawResourceFormat* format) = 0;
+	virtual HRESULT GetResourceSizeBytes(uint32_t* sizeBytes) = 0;
+};
+
+struct IBlackmagicRawClip : IUnknown {
+	virtual HRESULT GetWidth(uint32_t* width) = 0;
+	virtual HRESULT GetHeight(uint32_t* height) = 0;
+	virtual HRESULT GetFrameRate(float* frameRate) = 0;
+	virtual HRESULT GetFrameCount(uint64_t* frameCount) = 0;
+	virtual HRESULT GetTimecodeForFrame(uint64_t frameIndex, const char** timecode) = 0;
+	virtual HRESULT GetMetadataIterator(IBlackmagicRawMetadataIterator** iterator) = 0;
+	virtual HRESULT GetMetadata(const char* key, Variant* value) = 0;
+	virtual HRESULT GetCameraType(const char** cameraType) = 0;
+	virtual HRESULT CloneClipProcessingAttributes(IBlackmagicRawClipProcessingAttributes** attributes) = 0;
+	virtual HRESULT GetMulticardFileCount(uint32_t* count) = 0;
+	virtual HRESULT IsMulticardFilePresent(uint32_t index, bool* present) = 0;
+	virtual HRESULT GetSidecarFileAttached(bool* attached) = 0;
+	virtual HRESULT CreateJobReadFrame(uint64_t frameIndex, IBlackmagicRawJob** job) = 0;
+};
+
+struct IBlackmagicRawClipEx : IUnknown {
+	virtual HRESULT GetMaxBitStreamSizeBytes(uint32_t* sizeBytes) = 0;
+	virtual HRESULT GetBitStreamSizeBytes(uint64_t frameIndex, uint32_t* sizeBytes) = 0;
+	virtual HRESULT CreateJobReadFrame(uint64_t frameIndex, void* buffer, uint32_t bufferSizeBytes, IBlackmagicRawJob** job) = 0;
+	virtual HRESULT QueryTimecodeInfo(uint32_t* baseFrameIndex, bool* isDropFrame) = 0;
+};
+
+struct IBlackmagicRawClipResolutions : IUnknown {
+	virtual HRESULT GetResolutionCount(uint32_t* count) = 0;
+	virtual HRESULT GetResolution(uint32_t index, uint32_t* width, uint32_t* height) = 0;
+	virtual HRESULT GetClosestResolutionForScale(BlackmagicRawResolutionScale scale, uint32_t* width, uint32_t* height) = 0;
+	virtual HRESULT GetClosestScaleForResolution(uint32_t width, uint32_t height, bool requestUpsample, BlackmagicRawResolutionScale* scale) = 0;
+};
+
+struct IBlackmagicRawClipAudio : IUnknown {
+	virtual HRESULT GetAudioBitDepth(uint32_t* bitDepth) = 0;
+	virtual HRESULT GetAudioChannelCount(uint32_t* channelCount) = 0;
+	virtual HRESULT GetAudioSampleRate(uint32_t* sampleRate) = 0;
+	virtual HRESULT GetAudioSampleCount(uint64_t* sampleCount) = 0;
+	virtual HRESULT GetAudioSamples(int64_t sampleFrameIndex, void* buffer, uint32_t bufferSizeBytes, uint32_t maxSampleCount,
+		uint32_t* samplesRead, uint32_t* bytesRead) = 0;
+};
+
+struct IBlackmagicRawCallback : IUnknown {
+	virtual void ReadComplete(IBlackmagicRawJob* job, HRESULT result, IBlackmagicRawFrame* frame) = 0;
+	virtual void DecodeComplete(IBlackmagicRawJob* job, HRESULT result) = 0;
+	virtual void ProcessComplete(IBlackmagicRawJob* job, HRESULT result, IBlackmagicRawProcessedImage* processedImage) = 0;
+	virtual void TrimProgress(IBlackmagicRawJob* job, float progress) = 0;
+	virtual void TrimComplete(IBlackmagicRawJob* job, HRESULT result) = 0;
+	virtual void SidecarMetadataParseWarning(IBlackmagicRawClip* clip, const char* fileName, uint32_t lineNumber, const char* info) = 0;
+	virtual void SidecarMetadataParseError(IBlackmagicRawClip* clip, const char* fileName, uint32_t lineNumber, const char* info) = 0;
+	virtual void PreparePipelineComplete(void* userData, HRESULT result) = 0;
+};
+
+struct IBlackmagicRawConfiguration : IUnknown {
+	virtual HRESULT SetCPUThreads(uint32_t threadCount) = 0;
+	virtual HRESULT GetCPUThreads(uint32_t* threadCount) = 0;
+	virtual HRESULT GetMaxCPUThreadCount(uint32_t* threadCount) = 0;
+	virtual HRESULT SetWriteMetadataPerFrame(bool writePerFrame) = 0;
+};
+
+struct IBlackmagicRaw : IUnknown {
+	virtual HRESULT OpenClip(const char* fileName, IBlackmagicRawClip** clip) = 0;
+	virtual HRESULT SetCallback(IBlackmagicRawCallback* callback) = 0;
+	virtual HRESULT PreparePipeline(BlackmagicRawPipeline pipeline, void* pipelineContext, void* pipelineCommandQueue, void* userData) = 0;
+	virtual HRESULT FlushJobs() = 0;
+};
+
+struct IBlackmagicRawFactory : IUnknown {
+	virtual HRESULT CreateCodec(IBlackmagicRaw** codec) = 0;
+};
+
+IBlackmagicRawFactory* CreateBlackmagicRawFactoryInstanceFromPath(const char* loadPath);
+
+extern const REFIID IID_IBlackmagicRawClipAudio;
+extern const REFIID IID_IBlackmagicRawClipEx;
+extern const REFIID IID_IBlackmagicRawClipProcessingAttributes;
+extern const REFIID IID_IBlackmagicRawClipResolutions;
+extern const REFIID IID_IBlackmagicRawConfiguration;
+extern const REFIID IID_IBlackmagicRawFrameEx;
+
+#endif
@@ -0,0 +1,823 @@
+/* the sdk objects without decoding: clips of a fixed size, frames and processed images filled with zeros.
+   ownership follows the sdk: out parameters hand over a reference, a submitted job is held by the codec
+   until its callback returned, the processed image belongs to the decode job. every object is counted,
+   so the tests can check that the core releases everything it got */
+
+#include "synthetic.h"
+#include "BlackmagicRawAPI.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const REFIID IID_IBlackmagicRawClipAudio = { { 1 } };
+const REFIID IID_IBlackmagicRawClipEx = { { 2 } };
+const REFIID IID_IBlackmagicRawClipProcessingAttributes = { { 3 } };
+const REFIID IID_IBlackmagicRawClipResolutions = { { 4 } };
+const REFIID IID_IBlackmagicRawConfiguration = { { 5 } };
+const REFIID IID_IBlackmagicRawFrameEx = { { 6 } };
+
+namespace synthetic {
+
+static std::atomic<long> s_liveObjects(0);
+
+static std::mutex s_lock;
+static Clip s_clip;
+static int s_decodeMs = 0;
+static std::vector<uint64_t> s_readOrder;
+
+static std::mutex s_holdLock;
+static std::condition_variable s_holdChanged;
+static bool s_hold = false;
+
+void setClip(const Clip& clip) {
+	std::lock_guard<std::mutex> guard(s_lock);
+	s_clip = clip;
+}
+
+void holdJobs(bool hold) {
+	{
+		std::lock_guard<std::mutex> guard(s_holdLock);
+		s_hold = hold;
+	}
+	s_holdChanged.notify_all();
+}
+
+void setDecodeMs(int ms) {
+	std::lock_guard<std::mutex> guard(s_lock);
+	s_decodeMs = ms;
+}
+
+std::vector<uint64_t> readOrder() {
+	std::lock_guard<std::mutex> guard(s_lock);
+	return s_readOrder;
+}
+
+void clearReadOrder() {
+	std::lock_guard<std::mutex> guard(s_lock);
+	s_readOrder.clear();
+}
+
+long liveObjects() {
+	return s_liveObjects;
+}
+
+static void waitWhileHeld() {
+	std::unique_lock<std::mutex> guard(s_holdLock);
+	s_holdChanged.wait(guard, [] { return !s_hold; });
+}
+
+static bool sameIid(const REFIID& a, const REFIID& b) {
+	return memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0;
+}
+
+template<typename... Interfaces>
+class Object : public Interfaces... {
+	/* reference count shared by all interfaces of the object */
+public:
+	Object() {
+		s_liveObjects++;
+	}
+	virtual ~Object() {
+		s_liveObjects--;
+	}
+
+	HRESULT QueryInterface(REFIID, LPVOID* object) override {
+		*object = nullptr;
+		return E_NOINTERFACE;
+	}
+	ULONG AddRef() override {
+		return ++refs;
+	}
+	ULONG Release() override {
+		ULONG left = --refs;
+		if (left == 0)
+			delete this;
+		return left;
+	}
+
+private:
+	std::atomic<ULONG> refs{ 1 };
+};
+
+template<typename T>
+static HRESULT handOut(T* object, T** out) {
+	//out parameters get their own reference
+	object->AddRef();
+	*out = object;
+	return S_OK;
+}
+
+static size_t pixelBytes(BlackmagicRawResourceFormat format) {
+	switch (format) {
+		case blackmagicRawResourceFormatRGBU16:
+		case blackmagicRawResourceFormatRGBU16Planar:
+			return 6;
+		case blackmagicRawResourceFormatRGBAU16:
+		case blackmagicRawResourceFormatBGRAU16:
+			return 8;
+		case blackmagicRawResourceFormatRGBF32:
+		case blackmagicRawResourceFormatRGBF32Planar:
+			return 12;
+		case blackmagicRawResourceFormatBGRAF32:
+			return 16;
+		default:
+			return 4;
+	}
+}
+
+static uint32_t scaleDivisor(BlackmagicRawResolutionScale scale) {
+	switch (scale) {
+		case blackmagicRawResolutionScaleHalf: return 2;
+		case blackmagicRawResolutionScaleQuarter: return 4;
+		case blackmagicRawResolutionScaleEighth: return 8;
+		default: return 1;
+	}
+}
+
+class MetadataIterator : public Object<IBlackmagicRawMetadataIterator> {
+	/* a string, a number and an array, like the camera metadata has them */
+public:
+	MetadataIterator(uint64_t frameIndex) {
+		add("camera_type").set("Synthetic");
+		Entry& iso = add("iso");
+		iso.value.vt = blackmagicRawVariantTypeU32;
+		iso.value.uintVal = 800;
+		Entry& index = add("frame_index");
+		index.value.vt = blackmagicRawVariantTypeFloat64;
+		index.value.dblVal = (double)frameIndex;
+		Entry& lens = add("lens_range");
+		lens.numbers = { 24, 70 };
+		lens.array.variantType = blackmagicRawVariantTypeU16;
+		lens.array.cDims = 1;
+		lens.array.data = lens.numbers.data();
+		lens.array.bounds.lLbound = 0;
+		lens.array.bounds.cElements = (uint32_t)lens.numbers.size();
+		lens.value.vt = blackmagicRawVariantTypeSafeArray;
+		lens.value.parray = &lens.array;
+	}
+
+	HRESULT Next() override {
+		if (position + 1 >= entries.size())
+			return S_FALSE;
+		position++;
+		return S_OK;
+	}
+	HRESULT GetKey(const char** key) override {
+		*key = entries[position]->key.c_str();
+		return S_OK;
+	}
+	HRESULT GetData(Variant* data) override {
+		*data = entries[position]->value;
+		return S_OK;
+	}
+
+private:
+	struct Entry {
+		std::string key;
+		std::string text;
+		std::vector<uint16_t> numbers;
+		SafeArray array = {};
+		Variant value = {};
+
+		void set(const char* s) {
+			text = s;
+			value.vt = blackmagicRawVariantTypeString;
+			value.bstrVal = text.c_str();
+		}
+	};
+
+	Entry& add(const char* key) {
+		entries.emplace_back(new Entry());
+		entries.back()->key = key;
+		return *entries.back();
+	}
+
+	std::vector<std::unique_ptr<Entry>> entries;
+	size_t position = 0;
+};
+
+class ClipAttributes : public Object<IBlackmagicRawClipProcessingAttributes> {
+public:
+	HRESULT GetClipAttribute(BlackmagicRawClipProcessingAttribute, Variant*) override {
+		return E_NOTIMPL;
+	}
+	HRESULT SetClipAttribute(BlackmagicRawClipProcessingAttribute attribute, Variant* value) override {
+		if (value->vt != blackmagicRawVariantTypeString)
+			return E_INVALIDARG;
+		std::string name = value->bstrVal;
+		if (attribute == blackmagicRawClipProcessingAttributeGamma)
+			return name == "Blackmagic Design Film" || name == "Rec.709" ? S_OK : E_INVALIDARG;
+		if (attribute == blackmagicRawClipProcessingAttributeGamut)
+			return name == "Blackmagic Design" || name == "Rec.709" ? S_OK : E_INVALIDARG;
+		return E_NOTIMPL;
+	}
+	HRESULT GetPost3DLUT(IBlackmagicRawPost3DLUT** lut) override {
+		*lut = nullptr;
+		return E_FAIL;
+	}
+};
+
+class FrameAttributes : public Object<IBlackmagicRawFrameProcessingAttributes> {
+	/* only the range is checked, like a camera that takes any value in it */
+public:
+	HRESULT GetFrameAttribute(BlackmagicRawFrameProcessingAttribute, Variant*) override {
+		return E_NOTIMPL;
+	}
+	HRESULT SetFrameAttribute(BlackmagicRawFrameProcessingAttribute attribute, Variant* value) override {
+		switch (attribute) {
+			case blackmagicRawFrameProcessingAttributeISO:
+				return value->vt == blackmagicRawVariantTypeU32 && value->uintVal >= 100 && value->uintVal <= 25600 ? S_OK : E_INVALIDARG;
+			case blackmagicRawFrameProcessingAttributeWhiteBalanceKelvin:
+				return value->vt == blackmagicRawVariantTypeU32 && value->uintVal >= 2000 && value->uintVal <= 50000 ? S_OK : E_INVALIDARG;
+			case blackmagicRawFrameProcessingAttributeWhiteBalanceTint:
+				return value->vt == blackmagicRawVariantTypeS16 && value->iVal >= -50 && value->iVal <= 50 ? S_OK : E_INVALIDARG;
+			case blackmagicRawFrameProcessingAttributeExposure:
+				return value->vt == blackmagicRawVariantTypeFloat32 && value->fltVal >= -5 && value->fltVal <= 5 ? S_OK : E_INVALIDARG;
+			default:
+				return E_NOTIMPL;
+		}
+	}
+};
+
+class ProcessedImage : public Object<IBlackmagicRawProcessedImage> {
+public:
+	ProcessedImage(uint32_t width, uint32_t height, BlackmagicRawResourceFormat format) : width(width), height(height), format(format) {
+		pixels.resize((size_t)width * height * pixelBytes(format));
+	}
+
+	HRESULT GetWidth(uint32_t* w) override {
+		*w = width;
+		return S_OK;
+	}
+	HRESULT GetHeight(uint32_t* h) override {
+		*h = height;
+		return S_OK;
+	}
+	HRESULT GetResource(void** resource) override {
+		*resource = pixels.data();
+		return S_OK;
+	}
+	HRESULT GetResourceType(BlackmagicRawResourceType* type) override {
+		*type = blackmagicRawResourceTypeBufferCPU;
+		return S_OK;
+	}
+	HRESULT GetResourceFormat(BlackmagicRawResourceFormat* f) override {
+		*f = format;
+		return S_OK;
+	}
+	HRESULT GetResourceSizeBytes(uint32_t* sizeBytes) override {
+		*sizeBytes = (uint32_t)pixels.size();
+		return S_OK;
+	}
+
+private:
+	uint32_t width;
+	uint32_t height;
+	BlackmagicRawResourceFormat format;
+	std::vector<uint8_t> pixels;
+};
+
+class Codec;
+class SyntheticClip;
+
+class Job : public Object<IBlackmagicRawJob> {
+	/* runs on a worker of the codec, which holds a reference from Submit until the callback returned */
+public:
+	explicit Job(Codec* codec) : codec(codec) {}
+
+	HRESULT Submit() override;
+	HRESULT Abort() override {
+		return E_NOTIMPL;
+	}
+	HRESULT SetUserData(void* data) override {
+		userData = data;
+		return S_OK;
+	}
+	HRESULT GetUserData(void** data) override {
+		*data = userData;
+		return S_OK;
+	}
+
+	virtual void run(IBlackmagicRawCallback* callback) = 0;
+
+protected:
+	Codec* codec;
+	void* userData = nullptr;
+	bool submitted = false;
+};
+
+class Codec : public Object<IBlackmagicRaw, IBlackmagicRawConfiguration> {
+public:
+	~Codec() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stop = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers) {
+			if (worker.get_id() == std::this_thread::get_id())
+				worker.detach();
+			else
+				worker.join();
+		}
+		if (callback != nullptr)
+			callback->Release();
+	}
+
+	HRESULT QueryInterface(REFIID iid, LPVOID* object) override {
+		if (!sameIid(iid, IID_IBlackmagicRawConfiguration))
+			return Object::QueryInterface(iid, object);
+		return handOut<IBlackmagicRawConfiguration>(this, (IBlackmagicRawConfiguration**)object);
+	}
+
+	HRESULT OpenClip(const char* fileName, IBlackmagicRawClip** clip) override;
+
+	HRESULT SetCallback(IBlackmagicRawCallback* newCallback) override {
+		std::lock_guard<std::mutex> guard(lock);
+		if (newCallback != nullptr)
+			newCallback->AddRef();
+		if (callback != nullptr)
+			callback->Release();
+		callback = newCallback;
+		return S_OK;
+	}
+
+	HRESULT PreparePipeline(BlackmagicRawPipeline, void*, void*, void* userData) override {
+		enqueue(nullptr, userData);
+		return S_OK;
+	}
+
+	HRESULT FlushJobs() override {
+		std::unique_lock<std::mutex> guard(lock);
+		idle.wait(guard, [this] { return pending == 0; });
+		return S_OK;
+	}
+
+	HRESULT SetCPUThreads(uint32_t count) override {
+		std::lock_guard<std::mutex> guard(lock);
+		if (!workers.empty())
+			return E_FAIL;
+		threads = count;
+		return S_OK;
+	}
+	HRESULT GetCPUThreads(uint32_t* count) override {
+		*count = threads;
+		return S_OK;
+	}
+	HRESULT GetMaxCPUThreadCount(uint32_t* count) override {
+		*count = 64;
+		return S_OK;
+	}
+	HRESULT SetWriteMetadataPerFrame(bool) override {
+		return S_OK;
+	}
+
+	void enqueue(Job* job, void* pipelineUserData) {
+		/* the codec holds the job until its callback returned */
+		if (job != nullptr)
+			job->AddRef();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			tasks.push_back({ job, pipelineUserData });
+			pending++;
+			while (workers.size() < threads)
+				workers.emplace_back(&Codec::work, this);
+		}
+		wake.notify_one();
+	}
+
+private:
+	struct Task {
+		Job* job;
+		void* pipelineUserData;
+	};
+
+	void work() {
+		for (;;) {
+			Task task;
+			IBlackmagicRawCallback* target = nullptr;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wake.wait(guard, [this] { return stop || !tasks.empty(); });
+				if (tasks.empty())
+					return;
+				task = tasks.front();
+				tasks.pop_front();
+				target = callback;
+			}
+
+			if (task.job != nullptr) {
+				waitWhileHeld();
+				task.job->run(target);
+				task.job->Release();
+			}
+			else {
+				target->PreparePipelineComplete(task.pipelineUserData, S_OK);
+			}
+
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				pending--;
+			}
+			idle.notify_all();
+		}
+	}
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::deque<Task> tasks;
+	int pending = 0;
+	bool stop = false;
+	uint32_t threads = 2;
+	std::vector<std::thread> workers;
+	IBlackmagicRawCallback* callback = nullptr;
+};
+
+HRESULT Job::Submit() {
+	if (submitted)
+		return E_FAIL;
+	submitted = true;
+	codec->enqueue(this, nullptr);
+	return S_OK;
+}
+
+class SyntheticClip : public Object<IBlackmagicRawClip, IBlackmagicRawClipEx, IBlackmagicRawClipAudio, IBlackmagicRawClipResolutions> {
+public:
+	SyntheticClip(Codec* codec, const Clip& shape) : codec(codec), shape(shape) {
+		codec->AddRef();
+	}
+	~SyntheticClip() {
+		codec->Release();
+	}
+
+	Codec* codec;
+	Clip shape;
+
+	HRESULT QueryInterface(REFIID iid, LPVOID* object) override {
+		if (sameIid(iid, IID_IBlackmagicRawClipEx))
+			return handOut<IBlackmagicRawClipEx>(this, (IBlackmagicRawClipEx**)object);
+		if (sameIid(iid, IID_IBlackmagicRawClipAudio))
+			return handOut<IBlackmagicRawClipAudio>(this, (IBlackmagicRawClipAudio**)object);
+		if (sameIid(iid, IID_IBlackmagicRawClipResolutions))
+			return handOut<IBlackmagicRawClipResolutions>(this, (IBlackmagicRawClipResolutions**)object);
+		return Object::QueryInterface(iid, object);
+	}
+
+	HRESULT GetWidth(uint32_t* width) override {
+		*width = shape.width;
+		return S_OK;
+	}
+	HRESULT GetHeight(uint32_t* height) override {
+		*height = shape.height;
+		return S_OK;
+	}
+	HRESULT GetFrameRate(float* frameRate) override {
+		*frameRate = shape.frameRate;
+		return S_OK;
+	}
+	HRESULT GetFrameCount(uint64_t* frameCount) override {
+		*frameCount = shape.frameCount;
+		return S_OK;
+	}
+	HRESULT GetTimecodeForFrame(uint64_t frameIndex, const char** timecode) override {
+		*timecode = frameIndex == 0 ? "01:00:00:00" : nullptr;
+		return frameIndex == 0 ? S_OK : E_NOTIMPL;
+	}
+	HRESULT GetMetadataIterator(IBlackmagicRawMetadataIterator** iterator) override {
+		*iterator = new MetadataIterator(0);
+		return S_OK;
+	}
+	HRESULT GetMetadata(const char*, Variant*) override {
+		return E_NOTIMPL;
+	}
+	HRESULT GetCameraType(const char** cameraType) override {
+		*cameraType = "Synthetic";
+		return S_OK;
+	}
+	HRESULT CloneClipProcessingAttributes(IBlackmagicRawClipProcessingAttributes** attributes) override {
+		*attributes = new ClipAttributes();
+		return S_OK;
+	}
+	HRESULT GetMulticardFileCount(uint32_t* count) override {
+		*count = 0;
+		return S_OK;
+	}
+	HRESULT IsMulticardFilePresent(uint32_t, bool* present) override {
+		*present = false;
+		return E_INVALIDARG;
+	}
+	HRESULT GetSidecarFileAttached(bool* attached) override {
+		*attached = false;
+		return S_OK;
+	}
+	HRESULT CreateJobReadFrame(uint64_t frameIndex, IBlackmagicRawJob** job) override;
+
+	HRESULT GetMaxBitStreamSizeBytes(uint32_t* sizeBytes) override {
+		*sizeBytes = bitStreamBytes(6);
+		return S_OK;
+	}
+	HRESULT GetBitStreamSizeBytes(uint64_t frameIndex, uint32_t* sizeBytes) override {
+		if (frameIndex >= shape.frameCount)
+			return E_INVALIDARG;
+		*sizeBytes = bitStreamBytes(frameIndex);
+		return S_OK;
+	}
+	HRESULT CreateJobReadFrame(uint64_t, void*, uint32_t, IBlackmagicRawJob** job) override {
+		*job = nullptr;
+		return E_NOTIMPL;
+	}
+	HRESULT QueryTimecodeInfo(uint32_t* baseFrameIndex, bool* isDropFrame) override {
+		*baseFrameIndex = 0;
+		*isDropFrame = false;
+		return S_OK;
+	}
+
+	HRESULT GetAudioBitDepth(uint32_t* bitDepth) override {
+		*bitDepth = 16;
+		return S_OK;
+	}
+	HRESULT GetAudioChannelCount(uint32_t* channelCount) override {
+		*channelCount = 2;
+		return S_OK;
+	}
+	HRESULT GetAudioSampleRate(uint32_t* sampleRate) override {
+		*sampleRate = 48000;
+		return S_OK;
+	}
+	HRESULT GetAudioSampleCount(uint64_t* sampleCount) override {
+		*sampleCount = audioSamples();
+		return S_OK;
+	}
+	HRESULT GetAudioSamples(int64_t sampleFrameIndex, void* buffer, uint32_t bufferSizeBytes, uint32_t maxSampleCount,
+		uint32_t* samplesRead, uint32_t* bytesRead) override {
+		int64_t left = (int64_t)audioSamples() - sampleFrameIndex;
+		uint32_t samples = (uint32_t)std::max<int64_t>(std::min<int64_t>(left, std::min<uint32_t>(maxSampleCount, bufferSizeBytes / 4)), 0);
+		memset(buffer, 0, (size_t)samples * 4);
+		*samplesRead = samples;
+		*bytesRead = samples * 4;
+		return S_OK;
+	}
+
+	HRESULT GetResolutionCount(uint32_t* count) override {
+		*count = 4;
+		return S_OK;
+	}
+	HRESULT GetResolution(uint32_t index, uint32_t* width, uint32_t* height) override {
+		if (index >= 4)
+			return E_INVALIDARG;
+		*width = shape.width >> index;
+		*height = shape.height >> index;
+		return S_OK;
+	}
+	HRESULT GetClosestResolutionForScale(BlackmagicRawResolutionScale scale, uint32_t* width, uint32_t* height) override {
+		*width = shape.width / scaleDivisor(scale);
+		*height = shape.height / scaleDivisor(scale);
+		return S_OK;
+	}
+	HRESULT GetClosestScaleForResolution(uint32_t, uint32_t, bool, BlackmagicRawResolutionScale*) override {
+		return E_NOTIMPL;
+	}
+
+private:
+	uint64_t audioSamples() {
+		return (uint64_t)(shape.frameCount * 48000 / shape.frameRate);
+	}
+	uint32_t bitStreamBytes(uint64_t frameIndex) {
+		return 100000 + (uint32_t)(frameIndex % 7) * 1000;
+	}
+};
+
+class Frame : public Object<IBlackmagicRawFrame, IBlackmagicRawFrameEx> {
+public:
+	Frame(SyntheticClip* clip, uint64_t frameIndex) : clip(clip), frameIndex(frameIndex) {
+		clip->AddRef();
+		char buff[32] = {};
+		unsigned rate = (unsigned)clip->shape.frameRate;
+		uint64_t seconds = frameIndex / rate;
+		snprintf(buff, sizeof(buff), "01:%02u:%02u:%02u", (unsigned)(seconds / 60 % 60), (unsigned)(seconds % 60), (unsigned)(frameIndex % rate));
+		timecode = buff;
+	}
+	~Frame() {
+		clip->Release();
+	}
+
+	SyntheticClip* clip;
+	uint64_t frameIndex;
+	BlackmagicRawResourceFormat format = blackmagicRawResourceFormatRGBAU8;
+	BlackmagicRawResolutionScale scale = blackmagicRawResolutionScaleFull;
+
+	HRESULT QueryInterface(REFIID iid, LPVOID* object) override {
+		if (!sameIid(iid, IID_IBlackmagicRawFrameEx))
+			return Object::QueryInterface(iid, object);
+		return handOut<IBlackmagicRawFrameEx>(this, (IBlackmagicRawFrameEx**)object);
+	}
+
+	HRESULT GetFrameIndex(uint64_t* index) override {
+		*index = frameIndex;
+		return S_OK;
+	}
+	HRESULT GetTimecode(const char** tc) override {
+		*tc = timecode.c_str();
+		return S_OK;
+	}
+	HRESULT GetMetadataIterator(IBlackmagicRawMetadataIterator** iterator) override {
+		*iterator = new MetadataIterator(frameIndex);
+		return S_OK;
+	}
+	HRESULT GetMetadata(const char*, Variant*) override {
+		return E_NOTIMPL;
+	}
+	HRESULT CloneFrameProcessingAttributes(IBlackmagicRawFrameProcessingAttributes** attributes) override {
+		*attributes = new FrameAttributes();
+		return S_OK;
+	}
+	HRESULT SetResolutionScale(BlackmagicRawResolutionScale s) override {
+		scale = s;
+		return S_OK;
+	}
+	HRESULT GetResolutionScale(BlackmagicRawResolutionScale* s) override {
+		*s = scale;
+		return S_OK;
+	}
+	HRESULT SetResourceFormat(BlackmagicRawResourceFormat f) override {
+		format = f;
+		return S_OK;
+	}
+	HRESULT GetResourceFormat(BlackmagicRawResourceFormat* f) override {
+		*f = format;
+		return S_OK;
+	}
+	HRESULT CreateJobDecodeAndProcessFrame(IBlackmagicRawClipProcessingAttributes* clipAttributes,
+		IBlackmagicRawFrameProcessingAttributes* frameAttributes, IBlackmagicRawJob** job) override;
+
+	HRESULT GetBitStreamSizeBytes(uint32_t* sizeBytes) override {
+		return clip->GetBitStreamSizeBytes(frameIndex, sizeBytes);
+	}
+	HRESULT GetProcessedImageResolution(uint32_t* width, uint32_t* height) override {
+		*width = clip->shape.width / scaleDivisor(scale);
+		*height = clip->shape.height / scaleDivisor(scale);
+		return S_OK;
+	}
+
+private:
+	std::string timecode;
+};
+
+class ReadJob : public Job {
+public:
+	ReadJob(SyntheticClip* clip, uint64_t frameIndex) : Job(clip->codec), clip(clip), frameIndex(frameIndex) {
+		clip->AddRef();
+	}
+	~ReadJob() {
+		clip->Release();
+	}
+
+	HRESULT Submit() override {
+		{
+			std::lock_guard<std::mutex> guard(s_lock);
+			s_readOrder.push_back(frameIndex);
+		}
+		return Job::Submit();
+	}
+
+	void run(IBlackmagicRawCallback* callback) override {
+		//the frame is lent to the callback, whoever keeps it takes a reference
+		Frame* frame = new Frame(clip, frameIndex);
+		callback->ReadComplete(this, S_OK, frame);
+		frame->Release();
+	}
+
+private:
+	SyntheticClip* clip;
+	uint64_t frameIndex;
+};
+
+class DecodeAndProcessJob : public Job {
+public:
+	DecodeAndProcessJob(Frame* frame, IBlackmagicRawClipProcessingAttributes* clipAttributes, IBlackmagicRawFrameProcessingAttributes* frameAttributes)
+		: Job(frame->clip->codec), frame(frame), clipAttributes(clipAttributes), frameAttributes(frameAttributes) {
+		frame->AddRef();
+		if (clipAttributes != nullptr)
+			clipAttributes->AddRef();
+		if (frameAttributes != nullptr)
+			frameAttributes->AddRef();
+	}
+	~DecodeAndProcessJob() {
+		if (image != nullptr)
+			image->Release();
+		if (frameAttributes != nullptr)
+			frameAttributes->Release();
+		if (clipAttributes != nullptr)
+			clipAttributes->Release();
+		frame->Release();
+	}
+
+	void run(IBlackmagicRawCallback* callback) override {
+		int ms = 0;
+		{
+			std::lock_guard<std::mutex> guard(s_lock);
+			ms = s_decodeMs;
+		}
+		if (ms > 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+
+		uint32_t width = 0, height = 0;
+		frame->GetProcessedImageResolution(&width, &height);
+		image = new ProcessedImage(width, height, frame->format);
+		callback->ProcessComplete(this, S_OK, image);
+	}
+
+private:
+	Frame* frame;
+	IBlackmagicRawClipProcessingAttributes* clipAttributes;
+	IBlackmagicRawFrameProcessingAttributes* frameAttributes;
+	ProcessedImage* image = nullptr; //belongs to the job
+};
+
+HRESULT SyntheticClip::CreateJobReadFrame(uint64_t frameIndex, IBlackmagicRawJob** job) {
+	if (frameIndex >= shape.frameCount) {
+		*job = nullptr;
+		return E_INVALIDARG;
+	}
+	*job = new ReadJob(this, frameIndex);
+	return S_OK;
+}
+
+HRESULT Frame::CreateJobDecodeAndProcessFrame(IBlackmagicRawClipProcessingAttributes* clipAttributes,
+	IBlackmagicRawFrameProcessingAttributes* frameAttributes, IBlackmagicRawJob** job) {
+	*job = new DecodeAndProcessJob(this, clipAttributes, frameAttributes);
+	return S_OK;
+}
+
+HRESULT Codec::OpenClip(const char* fileName, IBlackmagicRawClip** clip) {
+	*clip = nullptr;
+	if (std::string(fileName).find("missing") != std::string::npos)
+		return E_FAIL;
+	std::lock_guard<std::mutex> guard(s_lock);
+	*clip = new SyntheticClip(this, s_clip);
+	return S_OK;
+}
+
+class Factory : public Object<IBlackmagicRawFactory> {
+public:
+	HRESULT CreateCodec(IBlackmagicRaw** codec) override {
+		*codec = new Codec();
+		return S_OK;
+	}
+};
+
+}
+
+IBlackmagicRawFactory* CreateBlackmagicRawFactoryInstanceFromPath(const char*) {
+	return new synthetic::Factory();
+}
+
+extern "C" {
+
+HRESULT VariantInit(Variant* variant) {
+	memset(variant, 0, sizeof(*variant));
+	variant->vt = blackmagicRawVariantTypeEmpty;
+	return S_OK;
+}
+
+HRESULT VariantClear(Variant* variant) {
+	//strings and arrays stay owned by the object that handed them out
+	return VariantInit(variant);
+}
+
+HRESULT SafeArrayGetVartype(SafeArray* array, BlackmagicRawVariantType* type) {
+	*type = array->variantType;
+	return S_OK;
+}
+
+HRESULT SafeArrayGetLBound(SafeArray* array, uint32_t, long* bound) {
+	*bound = (long)array->bounds.lLbound;
+	return S_OK;
+}
+
+HRESULT SafeArrayGetUBound(SafeArray* array, uint32_t, long* bound) {
+	*bound = (long)array->bounds.lLbound + (long)array->bounds.cElements - 1;
+	return S_OK;
+}
+
+HRESULT SafeArrayAccessData(SafeArray* array, void** data) {
+	*data = array->data;
+	return S_OK;
+}
+
+HRESULT SafeArrayUnaccessData(SafeArray*) {
+	return S_OK;
+}
+
+}
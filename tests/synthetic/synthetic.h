@@ -0,0 +1,29 @@
+
+#ifndef BMDSYNTHETICHEADER_H
+#define BMDSYNTHETICHEADER_H
+
+/* control of the synthetic sdk for the tests. every file name opens the same clip, names containing
+   "missing" fail to open. jobs run on worker threads of the codec like in the sdk and call back the same way */
+
+#include <cstdint>
+#include <vector>
+
+namespace synthetic {
+
+struct Clip {
+	uint32_t width = 64;
+	uint32_t height = 36;
+	uint64_t frameCount = 240;
+	float frameRate = 24;
+};
+
+void setClip(const Clip& clip);        //what clips opened from now on look like
+void holdJobs(bool hold);              //submitted jobs wait without running while held
+void setDecodeMs(int ms);              //time every decode job takes
+std::vector<uint64_t> readOrder();     //frame of every read job in the order the jobs were submitted
+void clearReadOrder();
+long liveObjects();                    //sdk objects that were created and not released yet
+
+}
+
+#endif
@@ -0,0 +1,99 @@
+/* FileReadAhead against a slow file: a consumer walks through the clip, the read ahead thread must fill its window
+   in front of it, but never get further. the file functions of common.cpp are replaced by an in-memory file that
+   takes a fixed time per read, like a NAS at a given throughput. the test waits for the progress of the reads,
+   never for a fixed time, so a slow machine only makes it take longer */
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "common.h"
+#include "readahead.h"
+
+static const uint64_t s_frameBytes = 1 << 20;
+static const uint64_t s_frames = 160;
+static const size_t s_windowBytes = 32 << 20;
+static const size_t s_chunkBytes = 4 << 20;   //one read of FileReadAhead
+static const int s_chunkMs = 8;               //500 MB/s
+static const double s_timeoutMs = 10000;
+
+static std::mutex s_lock;
+static std::condition_variable s_progress;
+static uint64_t s_readEnd = 0;                //furthest byte read so far
+static std::vector<uint64_t> s_offsets;       //start of every read
+
+void* openSequentialRead(const std::string& /*path*/, uint64_t& size) {
+	size = s_frames * s_frameBytes;
+	return new int(0);
+}
+
+bool readFileAt(void* /*file*/, uint64_t offset, void* /*buffer*/, uint32_t size, uint32_t& got) {
+	std::this_thread::sleep_for(std::chrono::milliseconds((s_chunkMs * size + s_chunkBytes - 1) / s_chunkBytes));
+	got = size;
+	{
+		std::lock_guard<std::mutex> guard(s_lock);
+		s_readEnd = std::max<uint64_t>(s_readEnd, offset + size);
+		s_offsets.push_back(offset);
+	}
+	s_progress.notify_all();
+	return true;
+}
+
+void closeFile(void* file) {
+	delete (int*)file;
+}
+
+static uint64_t waitForReadEnd(uint64_t end) {
+	/* the furthest byte read once it reaches end, fails the test if it does not within the timeout */
+	std::unique_lock<std::mutex> guard(s_lock);
+	bool reached = s_progress.wait_for(guard, std::chrono::duration<double, std::milli>(s_timeoutMs), [end] {
+		return s_readEnd >= end;
+	});
+	CHECK(reached);
+	return s_readEnd;
+}
+
+int main() {
+	FileReadAhead::File file;
+	file.name = "slow.braw";
+	file.frameCount = s_frames;
+	uint64_t fileBytes = s_frames * s_frameBytes;
+
+	{
+		FileReadAhead readAhead({ file }, s_windowBytes);
+
+		//every request moves the window, the reader fills it and stops at most one read past its end
+		for (uint64_t frame = 0; frame < s_frames; frame++) {
+			readAhead.onRequest(0, frame, true);
+			uint64_t end = waitForReadEnd(std::min<uint64_t>(frame * s_frameBytes + s_windowBytes, fileBytes));
+			CHECK(end <= frame * s_frameBytes + s_windowBytes + s_chunkBytes);
+		}
+		//the stats count a read after it returned
+		auto start = std::chrono::steady_clock::now();
+		while (readAhead.stats().bytesRead < fileBytes && elapsedMs(start) < s_timeoutMs)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		printf("%.1f MB read in %.0f ms\n", readAhead.stats().bytesRead / 1048576.0, readAhead.stats().readMs);
+		CHECK(readAhead.stats().bytesRead == fileBytes);
+
+		//random access stops it, the next sequential request starts again at its own frame and not at the jump
+		size_t readsBefore;
+		{
+			std::lock_guard<std::mutex> guard(s_lock);
+			readsBefore = s_offsets.size();
+			s_readEnd = 0;
+		}
+		readAhead.onRequest(0, 0, false);
+		readAhead.onRequest(0, 8, false);
+		uint64_t resume = 80;
+		readAhead.onRequest(0, resume, true);
+		waitForReadEnd(std::min<uint64_t>(resume * s_frameBytes + s_windowBytes, fileBytes));
+
+		std::lock_guard<std::mutex> guard(s_lock);
+		for (size_t i = readsBefore; i < s_offsets.size(); i++)
+			CHECK(s_offsets[i] >= resume * s_frameBytes);
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+/* the decoder hands at most s_maxStartedJobs read ahead jobs to the sdk, the rest waits in its queue.
+   a frame a source waits for must go to the sdk right away, whether it is new or read ahead that is still
+   queued. the synthetic sdk holds all jobs, so the order in which the decoder submits them is visible */
+
+#include <thread>
+
+#include "check.h"
+#include "memoryframe.h"
+#include "synthetic.h"
+
+static const size_t s_maxStartedJobs = 4; //see bmd.cpp
+
+static void waitForReads(size_t count) {
+	auto start = std::chrono::steady_clock::now();
+	while (synthetic::readOrder().size() < count && elapsedMs(start) < 5000)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	CHECK(synthetic::readOrder().size() >= count);
+}
+
+static std::unique_ptr<BRAWSDKProcessor> openAt(unsigned long long first) {
+	std::unique_ptr<BRAWSDKProcessor> proc(new BRAWSDKProcessor());
+	proc->openFile({ "scheduler.braw" }, 16);
+	proc->setRange(first, proc->frameCount - 1);
+	return proc;
+}
+
+int main() {
+	synthetic::holdJobs(true);
+
+	//one read ahead frame for each source on the same decoder, more than the sdk gets at once
+	std::vector<std::unique_ptr<BRAWSDKProcessor>> sources;
+	for (int i = 0; i < 6; i++) {
+		sources.push_back(openAt(i * 10));
+		sources.back()->warmUp(memoryFrames(*sources.back(), 16));
+	}
+	waitForReads(s_maxStartedJobs);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	CHECK(synthetic::readOrder() == std::vector<uint64_t>({ 0, 10, 20, 30 }));
+
+	//a new frame somebody waits for passes the queued read ahead (40 and 50)
+	std::unique_ptr<BRAWSDKProcessor> demanding = openAt(100);
+	std::thread fresh([&demanding] {
+		CHECK(demanding->fetchFrame(0, memoryFrames(*demanding, 16))->done);
+	});
+	waitForReads(s_maxStartedJobs + 1);
+	CHECK(synthetic::readOrder()[s_maxStartedJobs] == 100);
+
+	//queued read ahead that is asked for now starts before the read ahead queued ahead of it (40)
+	BRAWSDKProcessor& last = *sources.back();
+	std::thread promoted([&last] {
+		CHECK(last.fetchFrame(0, memoryFrames(last, 16))->done);
+	});
+	waitForReads(s_maxStartedJobs + 2);
+	CHECK(synthetic::readOrder()[s_maxStartedJobs + 1] == 50);
+
+	//the rest of the queue follows oldest first
+	synthetic::holdJobs(false);
+	fresh.join();
+	promoted.join();
+	waitForReads(s_maxStartedJobs + 3);
+	CHECK(synthetic::readOrder()[s_maxStartedJobs + 2] == 40);
+
+	sources.clear();
+	demanding.reset();
+	printf("read jobs in submit order:");
+	for (uint64_t frame : synthetic::readOrder())
+		printf(" %llu", (unsigned long long)frame);
+	printf("\n");
+
+	//everything the decoder got from the sdk is released, only the shared factory stays
+	CHECK(synthetic::liveObjects() == 1);
+	return 0;
+}
@@ -0,0 +1,109 @@
+/* opens, decodes and releases thousands of clips through the sources the plugins use, with the options that
+   take the other paths through the decoder (card spans, metadata, raw settings, shared decoders, caches,
+   open and decode errors). after every clip only the shared factory may be left of the sdk objects, and the
+   resident memory must not grow once the allocator has warmed up */
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "check.h"
+#include "memoryframe.h"
+#include "synthetic.h"
+
+static const int s_clips = 2000;
+static const int s_warmUpClips = 200;
+static const uint64_t s_maxGrowthBytes = 16 << 20;
+
+static uint64_t residentBytes() {
+	std::ifstream statm("/proc/self/statm");
+	uint64_t size = 0, resident = 0;
+	statm >> size >> resident;
+	return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+static void playClip(int i) {
+	std::vector<std::string> files = { "soak" + std::to_string(i) + ".braw" };
+	if (i % 4 == 0)
+		files.push_back("soak" + std::to_string(i) + "_2.braw"); //card span
+	if (i % 11 == 0)
+		files.push_back("missing.braw");
+
+	ProcessorOptions options;
+	options.metadata = i % 3 == 0;
+	options.compressedCacheMB = i % 6 == 0 ? 64 : 0;
+	options.readAheadMB = i % 9 == 0 ? 8 : 0;
+	if (i % 5 == 0) {
+		options.setIso = true;
+		options.iso = i % 13 == 0 ? 50 : 800; //50 is not supported
+	}
+	if (i % 7 == 0)
+		options.gamma = "Rec.709";
+	bool fails = i % 11 == 0;
+	bool rejected = i % 5 == 0 && i % 13 == 0; //opens, every frame fails
+
+	BRAWSDKProcessor master;
+	try {
+		master.openFile(files, 16, options);
+	}
+	catch (std::runtime_error&) {
+		CHECK(fails);
+		return;
+	}
+	CHECK(!fails);
+	master.setRange(0, master.frameCount - 1);
+	master.warmUp(memoryFrames(master, 16));
+	if (rejected) {
+		try {
+			master.fetchFrame(0, memoryFrames(master, 16));
+		}
+		catch (std::runtime_error&) {
+			return;
+		}
+		CHECK(!rejected);
+	}
+
+	//a proxy on the same files shares the decoder
+	std::unique_ptr<BRAWSDKProcessor> proxy;
+	if (i % 2 == 0) {
+		proxy.reset(new BRAWSDKProcessor());
+		proxy->openFile(files, 8, options);
+		proxy->setRange(0, proxy->frameCount - 1);
+	}
+
+	for (int n = 0; n < 6; n++) {
+		CHECK(master.fetchFrame(n, memoryFrames(master, 16))->done);
+		if (proxy)
+			CHECK(proxy->fetchFrame(n, memoryFrames(*proxy, 8))->done);
+	}
+	//a jump back, read ahead of the old position is dropped
+	CHECK(master.fetchFrame(i % 3, memoryFrames(master, 16))->done);
+
+	std::vector<uint8_t> audio(1000 * 4);
+	master.getAudioSamples(audio.data(), 0, 1000);
+}
+
+int main() {
+	synthetic::Clip clip;
+	clip.frameCount = 48;
+	synthetic::setClip(clip);
+
+	uint64_t warm = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < s_clips; i++) {
+		playClip(i);
+		//only the factory, it is shared by all decoders of the process and never released
+		if (synthetic::liveObjects() != 1)
+			fprintf(stderr, "clip %d: %ld sdk objects alive\n", i, synthetic::liveObjects());
+		CHECK(synthetic::liveObjects() == 1);
+		if (i + 1 == s_warmUpClips)
+			warm = residentBytes();
+	}
+	uint64_t end = residentBytes();
+
+	printf("%d clips in %.0f ms, resident %.1f MB after %d clips, %.1f MB at the end\n", s_clips, elapsedMs(start),
+		warm / 1048576.0, s_warmUpClips, end / 1048576.0);
+	CHECK(end < warm + s_maxGrowthBytes);
+	return 0;
+}
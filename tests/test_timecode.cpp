@@ -0,0 +1,46 @@
+/* timecodes of the start and end parameters, non drop frame and drop frame */
+
+#include "check.h"
+#include "common.h"
+
+static long long frames(const char* timecode, int fps) {
+	long long result = -1;
+	CHECK(parseTimecode(timecode, fps, result));
+	return result;
+}
+
+static bool rejected(const char* timecode, int fps) {
+	long long result = -1;
+	return !parseTimecode(timecode, fps, result);
+}
+
+int main() {
+	//non drop frame counts every label
+	CHECK(frames("00:00:01:00", 24) == 24);
+	CHECK(frames("01:00:00:00", 25) == 90000);
+	CHECK(frames("00:01:00:00", 30) == 1800);
+	CHECK(rejected("00:00:00:24", 24));
+	CHECK(rejected("00:60:00:00", 24));
+	CHECK(rejected("garbage", 24));
+
+	//29.97 drop frame skips ;00 and ;01 at every minute except every tenth
+	CHECK(frames("00:00:59;29", 30) == 1799);
+	CHECK(frames("00:01:00;02", 30) == 1800);
+	CHECK(frames("00:01:00.02", 30) == 1800);
+	CHECK(rejected("00:01:00;00", 30));
+	CHECK(rejected("00:01:00;01", 30));
+	CHECK(frames("00:10:00;00", 30) == 17982);
+	CHECK(frames("01:00:00;00", 30) == 107892);
+
+	//59.94 drops 4 labels
+	CHECK(frames("00:01:00;04", 60) == 3600);
+	CHECK(rejected("00:01:00;03", 60));
+	CHECK(frames("01:00:00;00", 60) == 215784);
+
+	//drop frame does not exist at other rates
+	CHECK(rejected("00:00:01;00", 24));
+	CHECK(rejected("00:00:01;00", 25));
+
+	printf("timecodes ok\n");
+	return 0;
+}